@@ -6,7 +6,6 @@
 #define make_DHelper(name) void concat(decode_, name) (vaddr_t *pc)
 typedef void (*DHelper) (vaddr_t *);
 
-#define OP_STR_SIZE 40
 enum { OP_TYPE_REG, OP_TYPE_MEM, OP_TYPE_IMM };
 
 typedef struct {
@@ -19,7 +18,7 @@ typedef struct {
     int32_t simm;
   };
   rtlreg_t val;
-  char str[OP_STR_SIZE];
+  int load_width;  // width of `val' loaded at decode time, 0 if not loaded
 } Operand;
 
 #include "isa/decode.h"
@@ -43,10 +42,9 @@ extern DecodeInfo decinfo;
 #define id_src2 (&decinfo.src2)
 #define id_dest (&decinfo.dest)
 
-#ifdef DEBUG
-#define print_Dop(...) snprintf(__VA_ARGS__)
-#else
-#define print_Dop(...)
-#endif
+/* The text of an operand is only made when the instruction is printed,
+ * from what is left of its decoding after execution. */
+void isa_op_str(char *buf, size_t size, const Operand *op);
+const char* op_str(const Operand *op);
 
 #endif
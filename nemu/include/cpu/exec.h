@@ -25,12 +25,7 @@ typedef struct {
 static inline uint32_t instr_fetch(vaddr_t *pc, int len) {
   uint32_t instr = vaddr_read(*pc, len);
 #ifdef DEBUG
-  uint8_t *p_instr = (void *)&instr;
-  int i;
-  for (i = 0; i < len; i ++) {
-    extern char log_bytebuf[];
-    strcatf(log_bytebuf, "%02x ", p_instr[i]);
-  }
+  itrace_fetch(&instr, len);
 #endif
   (*pc) += len;
   return instr;
@@ -51,10 +46,14 @@ static inline void update_pc(void) {
 void display_inv_msg(vaddr_t pc);
 
 #ifdef DEBUG
+/* The arguments are not evaluated unless the instruction is printed. */
+extern bool print_asm_on;
 #define print_asm(...) \
   do { \
-    extern char log_asmbuf[]; \
-    strcatf(log_asmbuf, __VA_ARGS__); \
+    if (unlikely(print_asm_on)) { \
+      extern char log_asmbuf[]; \
+      strcatf(log_asmbuf, __VA_ARGS__); \
+    } \
   } while (0)
 #else
 #define print_asm(...)
@@ -65,12 +64,12 @@ void display_inv_msg(vaddr_t pc);
 #endif
 
 #define print_asm_template1(instr) \
-  print_asm(str(instr) "%c %s", suffix_char(id_dest->width), id_dest->str)
+  print_asm(str(instr) "%c %s", suffix_char(id_dest->width), op_str(id_dest))
 
 #define print_asm_template2(instr) \
-  print_asm(str(instr) "%c %s,%s", suffix_char(id_dest->width), id_src->str, id_dest->str)
+  print_asm(str(instr) "%c %s,%s", suffix_char(id_dest->width), op_str(id_src), op_str(id_dest))
 
 #define print_asm_template3(instr) \
-  print_asm(str(instr) "%c %s,%s,%s", suffix_char(id_dest->width), id_src->str, id_src2->str, id_dest->str)
+  print_asm(str(instr) "%c %s,%s,%s", suffix_char(id_dest->width), op_str(id_src), op_str(id_src2), op_str(id_dest))
 
 #endif
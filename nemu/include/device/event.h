@@ -0,0 +1,37 @@
+#ifndef __EVENT_H__
+#define __EVENT_H__
+
+#include "common.h"
+
+/* Device events are scheduled by the number of guest instructions
+ * executed. The CPU stops at `event_deadline' to run the events due. */
+
+typedef void (*event_callback_t)(uint32_t);
+
+extern uint64_t g_nr_guest_instr;
+extern uint64_t event_deadline;
+
+/* Translated blocks are run in slices, and the instructions of a slice
+ * are added to `g_nr_guest_instr' only after it. `g_nr_slice_instr'
+ * counts those executed so far in the current slice, up to the start of
+ * the current block. */
+extern uint64_t g_nr_slice_instr;
+
+static inline uint64_t guest_instr_now(void) {
+  return g_nr_guest_instr + g_nr_slice_instr;
+}
+
+void init_event(void);
+void event_add(uint64_t delay, event_callback_t callback, uint32_t arg);
+void event_run(void);
+void event_warp(uint64_t delta);
+
+/* deterministic virtual time, see icount.c */
+void init_icount(int instr_per_us, bool enable_warp);
+bool icount_enabled(void);
+uint64_t icount_us_to_instr(uint64_t us);
+uint64_t icount_time_us(void);
+void icount_clock_read(void);
+void icount_idle(void);
+
+#endif
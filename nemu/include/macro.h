@@ -12,4 +12,7 @@
 
 #define MAP(c, f) c(f)
 
+#define likely(cond)   __builtin_expect(cond, 1)
+#define unlikely(cond) __builtin_expect(cond, 0)
+
 #endif
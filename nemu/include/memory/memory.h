@@ -2,6 +2,7 @@
 #define __MEMORY_H__
 
 #include "common.h"
+#include <sys/types.h>
 
 #define PMEM_SIZE (128 * 1024 * 1024)
 extern uint8_t pmem[];
@@ -14,6 +15,8 @@ extern uint8_t pmem[];
 #define host_to_guest(p) ((paddr_t)((void *)p - (void *)pmem))
 
 void register_pmem(paddr_t base);
+bool host_map_file(void *host, size_t len, int fd, off_t offset);
+void host_map_zero(void *host, size_t len);
 
 uint32_t isa_vaddr_read(vaddr_t, int);
 void isa_vaddr_write(vaddr_t, uint32_t, int);
@@ -21,11 +24,56 @@ void isa_vaddr_write(vaddr_t, uint32_t, int);
 #define vaddr_read isa_vaddr_read
 #define vaddr_write isa_vaddr_write
 
-uint32_t paddr_read(paddr_t, int);
-void paddr_write(paddr_t, uint32_t, int);
+/* counters to find a guest which is polling a device */
+extern uint64_t nr_vaddr_write;
+extern uint64_t nr_mmio_read;
+extern paddr_t last_mmio_read;
 
 #define PAGE_SIZE         4096
 #define PAGE_MASK         (PAGE_SIZE - 1)
 #define PG_ALIGN __attribute((aligned(PAGE_SIZE)))
 
+/* The physical address space is mapped in pages. `pmap_host' gives the
+ * host address of a page in pmem, and is NULL for other pages, and for
+ * pages under memory watchpoints. */
+#define PMAP_NR_PAGE (1u << (32 - 12))
+extern uint8_t *pmap_host[];
+
+uint32_t paddr_read(paddr_t, int);
+void paddr_write(paddr_t, uint32_t, int);
+uint32_t paddr_read_mmio(paddr_t, int);
+void paddr_write_mmio(paddr_t, uint32_t, int);
+void* paddr_host(paddr_t);
+void* pmem_host(paddr_t);
+void pmem_watch(paddr_t, int);
+void pmem_unwatch(paddr_t, int);
+
+void paddr_read_block(paddr_t, void *, size_t);
+void paddr_write_block(paddr_t, const void *, size_t);
+
+#ifdef DIFF_TEST
+void difftest_log_store(void *host, int len);
+#else
+#define difftest_log_store(host, len)
+#endif
+
+#define make_paddr_access(bits) \
+  static inline uint32_t concat(paddr_read, bits) (paddr_t addr) { \
+    uint8_t *host = pmap_host[addr / PAGE_SIZE]; \
+    if (likely(host != NULL)) return *(concat3(uint, bits, _t) *)(host + (addr & PAGE_MASK)); \
+    return paddr_read_mmio(addr, bits / 8); \
+  } \
+  static inline void concat(paddr_write, bits) (paddr_t addr, uint32_t data) { \
+    uint8_t *host = pmap_host[addr / PAGE_SIZE]; \
+    if (likely(host != NULL)) { \
+      difftest_log_store(host + (addr & PAGE_MASK), bits / 8); \
+      *(concat3(uint, bits, _t) *)(host + (addr & PAGE_MASK)) = data; \
+    } \
+    else paddr_write_mmio(addr, data, bits / 8); \
+  }
+
+make_paddr_access(8)
+make_paddr_access(16)
+make_paddr_access(32)
+
 #endif
@@ -0,0 +1,36 @@
+#ifndef __DIFF_HASH_H__
+#define __DIFF_HASH_H__
+
+/* The hash of memory compared between the DUT and the reference. It is
+ * also included by tools/qemu-diff, so it only depends on libc. */
+
+#include <stdint.h>
+#include <string.h>
+
+#define DIFF_HASH_PRIME 0x100000001b3ull
+
+static inline uint64_t diff_hash(const void *buf, size_t n) {
+  const uint8_t *p = buf;
+  // four independent lanes of 8-byte words, which the host can run in parallel
+  uint64_t h0 = 0xcbf29ce484222325ull, h1 = h0 + 1, h2 = h0 + 2, h3 = h0 + 3;
+  size_t i;
+  for (i = 0; i + 32 <= n; i += 32) {
+    uint64_t w[4];
+    memcpy(w, p + i, sizeof(w));
+    h0 = (h0 ^ w[0]) * DIFF_HASH_PRIME;
+    h1 = (h1 ^ w[1]) * DIFF_HASH_PRIME;
+    h2 = (h2 ^ w[2]) * DIFF_HASH_PRIME;
+    h3 = (h3 ^ w[3]) * DIFF_HASH_PRIME;
+  }
+  for (; i < n; i ++) {
+    h0 = (h0 ^ p[i]) * DIFF_HASH_PRIME;
+  }
+
+  uint64_t h = h0;
+  h = (h ^ (h1 >> 29) ^ (h1 << 35)) * DIFF_HASH_PRIME;
+  h = (h ^ (h2 >> 29) ^ (h2 << 35)) * DIFF_HASH_PRIME;
+  h = (h ^ (h3 >> 29) ^ (h3 << 35)) * DIFF_HASH_PRIME;
+  return h ^ (h >> 32) ^ n;
+}
+
+#endif
@@ -8,15 +8,20 @@
 void difftest_skip_ref(void);
 void difftest_skip_dut(int nr_ref, int nr_dut);
 void difftest_step(vaddr_t ori_pc, vaddr_t next_pc);
+void difftest_flush(void);
+void difftest_resync(void);
 #else
 #define difftest_skip_ref()
 #define difftest_skip_dut(nr_ref, nr_dut)
 #define difftest_step(ori_pc, next_pc)
+#define difftest_flush()
+#define difftest_resync()
 #endif
 
 extern void (*ref_difftest_memcpy_from_dut)(paddr_t dest, void *src, size_t n);
 extern void (*ref_difftest_getregs)(void *c);
 extern void (*ref_difftest_setregs)(const void *c);
 extern void (*ref_difftest_exec)(uint64_t n);
+extern void (*ref_difftest_exec_to)(uint64_t n, uint32_t pc, uint64_t hits);
 
 #endif
@@ -6,4 +6,11 @@
 uint32_t expr(char *, bool *);
 int htoi(char s[]);
 
+/* An expression compiled once, to be evaluated many times. */
+typedef struct Expr Expr;
+Expr* expr_compile(char *, bool *);
+uint32_t expr_eval(const Expr *, bool *);
+bool expr_deref_addr(const Expr *, vaddr_t *);
+void expr_free(Expr *);
+
 #endif
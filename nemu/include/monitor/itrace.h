@@ -0,0 +1,77 @@
+#ifndef __ITRACE_H__
+#define __ITRACE_H__
+
+/* The binary instruction trace. Each executed instruction is a record of
+ * fixed size, which is put into a ring buffer. With `--itrace=FILE', the
+ * ring is written to FILE by a background thread, after a header. The file
+ * is decoded by tools/itrace-dump, which also includes this header, so it
+ * only depends on libc. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define ITRACE_MAGIC "NEMUITR1"
+#define ITRACE_MAX_INSTR 16
+
+typedef struct {
+  char magic[8];
+  char isa[8];
+} ItraceHeader;
+
+enum {
+  ITRACE_REG = 0x1,    // `reg' is the first general register written, and `reg_val' its new value
+  ITRACE_LOAD = 0x2,   // `mem' is the address of the last load
+  ITRACE_STORE = 0x4,  // `mem' is the address of the last store
+};
+
+typedef struct {
+  uint32_t pc;
+  uint32_t mem;
+  uint32_t reg_val;
+  uint8_t len, flags, reg, pad;
+  uint8_t instr[ITRACE_MAX_INSTR];
+} ItraceRecord;
+
+/* Format `r' like a line of the old text log, with the register written
+ * and the memory accessed. NEMU does not disassemble, so `disasm' is the
+ * assembly from itrace-dump, or NULL. */
+static inline void itrace_format(char *buf, size_t size, const ItraceRecord *r, const char *gpr_name[],
+    const char *disasm) {
+  char bytes[3 * ITRACE_MAX_INSTR + 1] = "";
+  int i;
+  for (i = 0; i < r->len && i < ITRACE_MAX_INSTR; i ++) {
+    sprintf(bytes + 3 * i, "%02x ", r->instr[i]);
+  }
+  char reg[32] = "", mem[32] = "";
+  if (r->flags & ITRACE_REG) snprintf(reg, sizeof(reg), "  %s = 0x%08x", gpr_name[r->reg], r->reg_val);
+  if (r->flags & (ITRACE_LOAD | ITRACE_STORE)) {
+    snprintf(mem, sizeof(mem), "  %s 0x%08x", (r->flags & ITRACE_STORE ? "store" : "load"), r->mem);
+  }
+  int n = (disasm == NULL ? snprintf(buf, size, "%8x:   %-36s%s%s", r->pc, bytes, reg, mem) :
+      snprintf(buf, size, "%8x:   %-36s%-32s%s%s", r->pc, bytes, disasm, reg, mem));
+  if (n < 0) n = 0;
+  else if ((size_t)n >= size) n = size - 1;
+  while (n > 0 && buf[n - 1] == ' ') buf[-- n] = '\0';
+}
+
+/* The record of the instruction being executed. */
+extern ItraceRecord itrace_cur;
+
+static inline void itrace_fetch(const void *p, int len) {
+  if (itrace_cur.len + len <= ITRACE_MAX_INSTR) {
+    memcpy(itrace_cur.instr + itrace_cur.len, p, len);
+    itrace_cur.len += len;
+  }
+}
+
+static inline void itrace_mem(uint32_t addr, int is_store) {
+  itrace_cur.mem = addr;
+  itrace_cur.flags = (itrace_cur.flags & ~(ITRACE_LOAD | ITRACE_STORE)) | (is_store ? ITRACE_STORE : ITRACE_LOAD);
+}
+
+void itrace_begin(uint32_t pc);
+void itrace_end(void);
+void itrace_report(void);
+
+#endif
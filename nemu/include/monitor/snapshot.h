@@ -0,0 +1,18 @@
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include "common.h"
+
+/* A snapshot saves the regions of machine state registered here, in the
+ * order of registration. `loaded' is called after a region is restored,
+ * and may be NULL. */
+void snapshot_register(const char *name, void *addr, size_t size, void (*loaded)(void));
+
+/* `loaded' is called after a snapshot is loaded, for the state which is
+ * not saved but derived from the saved one. */
+void snapshot_add_hook(void (*loaded)(void));
+
+bool snapshot_save(const char *file);
+bool snapshot_load(const char *file);
+
+#endif
@@ -2,6 +2,7 @@
 #define __WATCHPOINT_H__
 
 #include "common.h"
+#include "monitor/expr.h"
 
 #define LEN_WP_NAME 32
 
@@ -11,14 +12,34 @@ typedef struct watchpoint {
 
   /* TODO: Add more members if necessary */
   char exp[LEN_WP_NAME];
+  Expr *code;  // `exp' compiled
   uint32_t value;
+  bool is_mem;  // `exp' is `*addr', checked on stores to its page
+  paddr_t addr;
+  bool is_bp;  // a breakpoint at `pc', if `code' is NULL or not zero
+  vaddr_t pc;
+  struct watchpoint *bp_next;  // in the same slot of the breakpoint table
 
 } WP;
 
 void new_wp();
+void new_bp(char *args);
 void free_wp(WP *wp);
 void delete_wp(int num);
 void info_wp_display();
 bool check();
+bool wp_exist(void);
+
+/* Breakpoints are looked up by PC in a hash table, only when a block is
+ * entered, and blocks are split at them. */
+extern int nr_bp;
+bool bp_hit_slow(vaddr_t pc);
+bool bp_is_set(vaddr_t pc);
+void bp_resume(void);
+
+/* Return true and stop the CPU if it should stop before `pc'. */
+static inline bool bp_hit(vaddr_t pc) {
+  return unlikely(nr_bp > 0) && bp_hit_slow(pc);
+}
 
 #endif
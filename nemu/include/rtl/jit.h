@@ -0,0 +1,68 @@
+#ifndef __RTL_JIT_H__
+#define __RTL_JIT_H__
+
+#include "common.h"
+
+/* The JIT backend of RTL. While `jit_emitting' is set, RTL instructions
+ * emit host x86-64 code for themselves instead of being interpreted.
+ * Execution helpers are run once at translation time in this mode, so
+ * they should only access the guest state through RTL instructions. A
+ * helper with any other effect (on the state, devices, or difftest) must
+ * opt out by calling jit_instr_fail() while emitting, and the instruction
+ * will be interpreted instead. Only a change to `cpu' is caught afterwards.
+ */
+
+extern bool jit_emitting;
+
+void jit_rtl_li(rtlreg_t* dest, uint32_t imm);
+void jit_rtl_mv(rtlreg_t* dest, const rtlreg_t *src1);
+
+#define make_jit_rtl_arith_logic(name) \
+  void concat(jit_rtl_, name) (rtlreg_t* dest, const rtlreg_t* src1, const rtlreg_t* src2);
+
+make_jit_rtl_arith_logic(add)
+make_jit_rtl_arith_logic(sub)
+make_jit_rtl_arith_logic(and)
+make_jit_rtl_arith_logic(or)
+make_jit_rtl_arith_logic(xor)
+make_jit_rtl_arith_logic(shl)
+make_jit_rtl_arith_logic(shr)
+make_jit_rtl_arith_logic(sar)
+make_jit_rtl_arith_logic(mul_lo)
+make_jit_rtl_arith_logic(mul_hi)
+make_jit_rtl_arith_logic(imul_lo)
+make_jit_rtl_arith_logic(imul_hi)
+make_jit_rtl_arith_logic(div_q)
+make_jit_rtl_arith_logic(div_r)
+make_jit_rtl_arith_logic(idiv_q)
+make_jit_rtl_arith_logic(idiv_r)
+
+void jit_rtl_div64(rtlreg_t* dest,
+    const rtlreg_t* src1_hi, const rtlreg_t* src1_lo, const rtlreg_t* src2);
+void jit_rtl_lm(rtlreg_t *dest, const rtlreg_t* addr, int len);
+void jit_rtl_sm(const rtlreg_t* addr, const rtlreg_t* src1, int len);
+void jit_rtl_host_lm(rtlreg_t* dest, const void *addr, int len);
+void jit_rtl_host_sm(void *addr, const rtlreg_t *src1, int len);
+void jit_rtl_setrelop(uint32_t relop, rtlreg_t *dest,
+    const rtlreg_t *src1, const rtlreg_t *src2);
+void jit_rtl_j(vaddr_t target);
+void jit_rtl_jr(rtlreg_t *target);
+void jit_rtl_jrelop(uint32_t relop,
+    const rtlreg_t *src1, const rtlreg_t *src2, vaddr_t target);
+void jit_rtl_exit(int state, vaddr_t halt_pc, uint32_t halt_ret);
+
+/* Interface for translating a block. A translated block returns the
+ * number of guest instructions it has executed. */
+typedef uint32_t (*JitCode)(void);
+
+bool jit_enabled(void);
+bool jit_block_begin(void);
+void jit_instr_begin(void);
+bool jit_instr_end(void);
+void jit_instr_fail(void);
+void jit_instr_call(void (*fn)(void *), void *arg);
+void jit_instr_exit_check(const bool *flag, uint32_t nr_done);
+JitCode jit_block_end(uint32_t nr_instr);
+void jit_flush(void);
+
+#endif
@@ -3,7 +3,8 @@
 
 #include "macro.h"
 
-#define RTL_PREFIX interpret
+// interpret or emit host code at run time, see rtl/rtl.h
+#define RTL_PREFIX dispatch
 
 #define rtl_li        concat(RTL_PREFIX, _rtl_li      )
 #define rtl_mv        concat(RTL_PREFIX, _rtl_mv      )
@@ -5,6 +5,8 @@
 #include "rtl/c_op.h"
 #include "rtl/relop.h"
 #include "rtl/rtl-wrapper.h"
+#include "rtl/jit.h"
+#include "monitor/itrace.h"
 
 extern rtlreg_t s0, s1, t0, t1, ir;
 
@@ -21,10 +23,24 @@ static inline void interpret_rtl_mv(rtlreg_t* dest, const rtlreg_t *src1) {
   *dest = *src1;
 }
 
+static inline void dispatch_rtl_li(rtlreg_t* dest, uint32_t imm) {
+  if (unlikely(jit_emitting)) jit_rtl_li(dest, imm);
+  else interpret_rtl_li(dest, imm);
+}
+
+static inline void dispatch_rtl_mv(rtlreg_t* dest, const rtlreg_t *src1) {
+  if (unlikely(jit_emitting)) jit_rtl_mv(dest, src1);
+  else interpret_rtl_mv(dest, src1);
+}
+
 #define make_rtl_arith_logic(name) \
   static inline void concat(interpret_rtl_, name) (rtlreg_t* dest, const rtlreg_t* src1, const rtlreg_t* src2) { \
     *dest = concat(c_, name) (*src1, *src2); \
   } \
+  static inline void concat(dispatch_rtl_, name) (rtlreg_t* dest, const rtlreg_t* src1, const rtlreg_t* src2) { \
+    if (unlikely(jit_emitting)) concat(jit_rtl_, name) (dest, src1, src2); \
+    else concat(interpret_rtl_, name) (dest, src1, src2); \
+  } \
   /* Actually those of imm version are pseudo rtl instructions,
    * but we define them here in the same macro */ \
   static inline void concat(rtl_, name ## i) (rtlreg_t* dest, const rtlreg_t* src1, int imm) { \
@@ -78,10 +94,16 @@ static inline void interpret_rtl_idiv64_r(rtlreg_t* dest,
 }
 
 static inline void interpret_rtl_lm(rtlreg_t *dest, const rtlreg_t* addr, int len) {
+#ifdef DEBUG
+  itrace_mem(*addr, false);
+#endif
   *dest = vaddr_read(*addr, len);
 }
 
 static inline void interpret_rtl_sm(const rtlreg_t* addr, const rtlreg_t* src1, int len) {
+#ifdef DEBUG
+  itrace_mem(*addr, true);
+#endif
   vaddr_write(*addr, *src1, len);
 }
 
@@ -127,6 +149,68 @@ static inline void interpret_rtl_jrelop(uint32_t relop,
 
 void interpret_rtl_exit(int state, vaddr_t halt_pc, uint32_t halt_ret);
 
+/* Each RTL instruction is either interpreted, or emitted by the JIT
+ * backend while a block is being translated. */
+
+#define make_rtl_dispatch_div64(name) \
+  static inline void concat(dispatch_rtl_, name) (rtlreg_t* dest, \
+      const rtlreg_t* src1_hi, const rtlreg_t* src1_lo, const rtlreg_t* src2) { \
+    if (unlikely(jit_emitting)) jit_rtl_div64(dest, src1_hi, src1_lo, src2); \
+    else concat(interpret_rtl_, name) (dest, src1_hi, src1_lo, src2); \
+  }
+
+make_rtl_dispatch_div64(div64_q)
+make_rtl_dispatch_div64(div64_r)
+make_rtl_dispatch_div64(idiv64_q)
+make_rtl_dispatch_div64(idiv64_r)
+
+static inline void dispatch_rtl_lm(rtlreg_t *dest, const rtlreg_t* addr, int len) {
+  if (unlikely(jit_emitting)) jit_rtl_lm(dest, addr, len);
+  else interpret_rtl_lm(dest, addr, len);
+}
+
+static inline void dispatch_rtl_sm(const rtlreg_t* addr, const rtlreg_t* src1, int len) {
+  if (unlikely(jit_emitting)) jit_rtl_sm(addr, src1, len);
+  else interpret_rtl_sm(addr, src1, len);
+}
+
+static inline void dispatch_rtl_host_lm(rtlreg_t* dest, const void *addr, int len) {
+  if (unlikely(jit_emitting)) jit_rtl_host_lm(dest, addr, len);
+  else interpret_rtl_host_lm(dest, addr, len);
+}
+
+static inline void dispatch_rtl_host_sm(void *addr, const rtlreg_t *src1, int len) {
+  if (unlikely(jit_emitting)) jit_rtl_host_sm(addr, src1, len);
+  else interpret_rtl_host_sm(addr, src1, len);
+}
+
+static inline void dispatch_rtl_setrelop(uint32_t relop, rtlreg_t *dest,
+    const rtlreg_t *src1, const rtlreg_t *src2) {
+  if (unlikely(jit_emitting)) jit_rtl_setrelop(relop, dest, src1, src2);
+  else interpret_rtl_setrelop(relop, dest, src1, src2);
+}
+
+static inline void dispatch_rtl_j(vaddr_t target) {
+  if (unlikely(jit_emitting)) jit_rtl_j(target);
+  else interpret_rtl_j(target);
+}
+
+static inline void dispatch_rtl_jr(rtlreg_t *target) {
+  if (unlikely(jit_emitting)) jit_rtl_jr(target);
+  else interpret_rtl_jr(target);
+}
+
+static inline void dispatch_rtl_jrelop(uint32_t relop,
+    const rtlreg_t *src1, const rtlreg_t *src2, vaddr_t target) {
+  if (unlikely(jit_emitting)) jit_rtl_jrelop(relop, src1, src2, target);
+  else interpret_rtl_jrelop(relop, src1, src2, target);
+}
+
+static inline void dispatch_rtl_exit(int state, vaddr_t halt_pc, uint32_t halt_ret) {
+  if (unlikely(jit_emitting)) jit_rtl_exit(state, halt_pc, halt_ret);
+  else interpret_rtl_exit(state, halt_pc, halt_ret);
+}
+
 
 /* RTL pseudo instructions */
 
@@ -0,0 +1,537 @@
+#include "cpu/exec.h"
+#include <sys/mman.h>
+
+/* A simple x86-64 code generator for RTL. Every RTL register is kept in
+ * memory and addressed through rbx, which points to `cpu' while a block
+ * is running. RTL registers are all static (guest registers, temporaries
+ * and fields of `decinfo'), so they are within 32-bit displacements.
+ * Memory accesses call vaddr_read() and vaddr_write().
+ *
+ * The RTL instructions of a block are first recorded as a list of IR.
+ * A liveness pass then removes the writes to temporaries and guest state
+ * which are overwritten before being read, and the rest is emitted.
+ *
+ * An instruction whose helper can not be translated (e.g. it uses rtl_exit
+ * or some locals as RTL registers) is rewound, and the caller falls back
+ * to interpret it with jit_instr_call().
+ */
+
+#define JIT_CODE_SIZE (16 * 1024 * 1024)
+#define JIT_NR_IR 4096
+// IR reserved for calls and exit checks of a block
+#define JIT_NR_IR_RESERVED 256
+// host code of an IR is not larger than this
+#define JIT_IR_CODE_SIZE 48
+
+enum {
+  IR_NOP, IR_LI, IR_MV, IR_ALU, IR_SHIFT, IR_MUL_LO, IR_MULDIV,
+  IR_LM, IR_SM, IR_HOST_LM, IR_HOST_SM, IR_SETRELOP,
+  IR_J, IR_JR, IR_JRELOP, IR_CALL, IR_EXIT_CHECK,
+};
+
+typedef struct {
+  int type;
+  uint8_t opcode, ext;  // host opcode and extension of IR_ALU, IR_SHIFT and IR_MULDIV
+  int len;
+  uint32_t relop;
+  uint32_t imm;         // also the jump target, or the number of instructions done
+  void *dest;
+  const void *src1, *src2;
+  void (*fn)(void *);
+  void *arg;
+} JitIR;
+
+bool jit_emitting = false;
+
+static bool jit_on = false;
+static uint8_t *code_buf = NULL;
+static uint8_t *code_ptr = NULL;
+
+static JitIR ir_buf[JIT_NR_IR];
+static int nr_ir = 0;
+static int instr_ir_start = 0;
+static bool instr_fail = false;
+// whether the instruction may leave the block
+static bool instr_may_exit = false;
+
+void init_jit(bool enable) {
+  if (!enable) return;
+
+#ifndef __x86_64__
+  panic("JIT is only supported on x86-64 hosts");
+#endif
+
+#ifdef DIFF_TEST
+  panic("--jit can not be used with DIFF_TEST, which checks every instruction");
+#endif
+
+  code_buf = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  Assert(code_buf != MAP_FAILED, "Can not allocate the JIT code buffer");
+  code_ptr = code_buf;
+  jit_on = true;
+  Log("JIT: \33[1;32m%s\33[0m", "ON");
+#ifdef DEBUG
+  Log("Instructions run by blocks are not traced. Execution falls back to "
+      "one instruction at a time while watchpoints are set.");
+#endif
+}
+
+bool jit_enabled(void) {
+  return jit_on;
+}
+
+void jit_flush(void) {
+  // code being executed is not touched until the next translation
+  code_ptr = code_buf;
+}
+
+void jit_instr_fail(void) {
+  instr_fail = true;
+}
+
+/* displacement of an RTL register from rbx */
+static int32_t jit_disp(const void *p) {
+  intptr_t d = (intptr_t)p - (intptr_t)&cpu;
+  if (d != (int32_t)d) { jit_instr_fail(); return 0; }
+
+  // a local of the helper will be gone at run time
+  char probe;
+  if ((uintptr_t)p >= (uintptr_t)&probe &&
+      (uintptr_t)p < (uintptr_t)__builtin_frame_address(0) + 0x10000) {
+    jit_instr_fail();
+    return 0;
+  }
+  return d;
+}
+
+/* IR recording */
+
+static JitIR* ir_new(int type, void *dest, const void *src1, const void *src2) {
+  static JitIR dummy;
+  if (nr_ir >= JIT_NR_IR - JIT_NR_IR_RESERVED) {
+    jit_instr_fail();
+    return &dummy;
+  }
+
+  if (dest != NULL) jit_disp(dest);
+  if (src1 != NULL) jit_disp(src1);
+  if (src2 != NULL) jit_disp(src2);
+
+  JitIR *e = &ir_buf[nr_ir ++];
+  e->type = type;
+  e->len = 4;
+  e->dest = dest;
+  e->src1 = src1;
+  e->src2 = src2;
+  return e;
+}
+
+void jit_rtl_li(rtlreg_t* dest, uint32_t imm) {
+  ir_new(IR_LI, dest, NULL, NULL)->imm = imm;
+}
+
+void jit_rtl_mv(rtlreg_t* dest, const rtlreg_t *src1) {
+  if (dest == src1) return;
+  ir_new(IR_MV, dest, src1, NULL);
+}
+
+#define make_jit_rtl_ir(name, type_, opcode_, ext_) \
+  void concat(jit_rtl_, name) (rtlreg_t* dest, const rtlreg_t* src1, const rtlreg_t* src2) { \
+    JitIR *e = ir_new(type_, dest, src1, src2); \
+    e->opcode = opcode_; \
+    e->ext = ext_; \
+  }
+
+enum { EAX = 0, ECX, EDX, EBX, ESP, EBP, ESI, EDI };
+
+make_jit_rtl_ir(add, IR_ALU, 0x03, 0)
+make_jit_rtl_ir(sub, IR_ALU, 0x2b, 0)
+make_jit_rtl_ir(and, IR_ALU, 0x23, 0)
+make_jit_rtl_ir(or,  IR_ALU, 0x0b, 0)
+make_jit_rtl_ir(xor, IR_ALU, 0x33, 0)
+make_jit_rtl_ir(shl, IR_SHIFT, 0, 4)
+make_jit_rtl_ir(shr, IR_SHIFT, 0, 5)
+make_jit_rtl_ir(sar, IR_SHIFT, 0, 7)
+make_jit_rtl_ir(mul_lo,  IR_MUL_LO, 0, 0)
+make_jit_rtl_ir(imul_lo, IR_MUL_LO, 0, 0)
+// for IR_MULDIV, `opcode' is the host register of the result
+make_jit_rtl_ir(mul_hi,  IR_MULDIV, EDX, 4)
+make_jit_rtl_ir(imul_hi, IR_MULDIV, EDX, 5)
+make_jit_rtl_ir(div_q,   IR_MULDIV, EAX, 6)
+make_jit_rtl_ir(div_r,   IR_MULDIV, EDX, 6)
+make_jit_rtl_ir(idiv_q,  IR_MULDIV, EAX, 7)
+make_jit_rtl_ir(idiv_r,  IR_MULDIV, EDX, 7)
+
+void jit_rtl_div64(rtlreg_t* dest,
+    const rtlreg_t* src1_hi, const rtlreg_t* src1_lo, const rtlreg_t* src2) {
+  // the host traps if the quotient overflows, leave it to the interpreter
+  jit_instr_fail();
+}
+
+void jit_rtl_lm(rtlreg_t *dest, const rtlreg_t* addr, int len) {
+  ir_new(IR_LM, dest, addr, NULL)->len = len;
+}
+
+void jit_rtl_sm(const rtlreg_t* addr, const rtlreg_t* src1, int len) {
+  ir_new(IR_SM, NULL, addr, src1)->len = len;
+  // the store may modify the code being executed
+  instr_may_exit = true;
+}
+
+void jit_rtl_host_lm(rtlreg_t* dest, const void *addr, int len) {
+  assert(len == 1 || len == 2 || len == 4);
+  ir_new(IR_HOST_LM, dest, addr, NULL)->len = len;
+}
+
+void jit_rtl_host_sm(void *addr, const rtlreg_t *src1, int len) {
+  assert(len == 1 || len == 2 || len == 4);
+  ir_new(IR_HOST_SM, addr, src1, NULL)->len = len;
+}
+
+void jit_rtl_setrelop(uint32_t relop, rtlreg_t *dest,
+    const rtlreg_t *src1, const rtlreg_t *src2) {
+  ir_new(IR_SETRELOP, dest, src1, src2)->relop = relop;
+}
+
+void jit_rtl_j(vaddr_t target) {
+  ir_new(IR_J, NULL, NULL, NULL)->imm = target;
+  instr_may_exit = true;
+}
+
+void jit_rtl_jr(rtlreg_t *target) {
+  ir_new(IR_JR, NULL, target, NULL);
+  instr_may_exit = true;
+}
+
+void jit_rtl_jrelop(uint32_t relop,
+    const rtlreg_t *src1, const rtlreg_t *src2, vaddr_t target) {
+  JitIR *e = ir_new(IR_JRELOP, NULL, src1, src2);
+  e->relop = relop;
+  e->imm = target;
+  instr_may_exit = true;
+}
+
+void jit_rtl_exit(int state, vaddr_t halt_pc, uint32_t halt_ret) {
+  // the arguments are evaluated at translation time
+  jit_instr_fail();
+}
+
+/* Liveness of RTL registers, tracked by aligned 32-bit words. Temporaries
+ * and `decinfo' are scratch, and are dead whenever the block may be left.
+ * Any other word is live at that time. Between the exits, a word which is
+ * fully overwritten before being read is dead. */
+
+#define NR_LIVE_SET 512
+
+static uintptr_t live_scratch[NR_LIVE_SET];  // scratch words which are live
+static uintptr_t dead_state[NR_LIVE_SET];    // other words which are dead
+static int nr_live_scratch, nr_dead_state;
+static bool scratch_overflow;
+
+static inline uintptr_t word_of(const void *p) {
+  return (uintptr_t)p & ~(uintptr_t)3;
+}
+
+static bool is_scratch(uintptr_t w) {
+  if (w == (uintptr_t)&s0 || w == (uintptr_t)&s1 || w == (uintptr_t)&t0 ||
+      w == (uintptr_t)&t1 || w == (uintptr_t)&ir) return true;
+  // `is_jmp' is read after the block is left
+  return (w >= (uintptr_t)&decinfo && w < (uintptr_t)(&decinfo + 1) &&
+      w != word_of(&decinfo.is_jmp));
+}
+
+static inline int set_find(uintptr_t *set, int n, uintptr_t w) {
+  int i;
+  for (i = 0; i < n; i ++) {
+    if (set[i] == w) return i;
+  }
+  return -1;
+}
+
+static inline void set_remove(uintptr_t *set, int *n, uintptr_t w) {
+  int i = set_find(set, *n, w);
+  if (i != -1) { set[i] = set[-- *n]; }
+}
+
+static bool is_live(const void *p) {
+  uintptr_t w = word_of(p);
+  if (is_scratch(w)) return scratch_overflow || set_find(live_scratch, nr_live_scratch, w) != -1;
+  return set_find(dead_state, nr_dead_state, w) == -1;
+}
+
+static void mark_read(const void *p, int len) {
+  uintptr_t w = word_of(p);
+  uintptr_t last = word_of((const uint8_t *)p + len - 1);
+  for (; w <= last; w += 4) {
+    if (is_scratch(w)) {
+      if (set_find(live_scratch, nr_live_scratch, w) != -1) continue;
+      if (nr_live_scratch == NR_LIVE_SET) scratch_overflow = true;
+      else live_scratch[nr_live_scratch ++] = w;
+    }
+    else {
+      set_remove(dead_state, &nr_dead_state, w);
+    }
+  }
+}
+
+static void mark_written(const void *p, int len) {
+  if (len != 4 || ((uintptr_t)p & 3) != 0) return;  // partially written
+  uintptr_t w = (uintptr_t)p;
+  if (is_scratch(w)) {
+    set_remove(live_scratch, &nr_live_scratch, w);
+  }
+  else if (set_find(dead_state, nr_dead_state, w) == -1 && nr_dead_state < NR_LIVE_SET) {
+    dead_state[nr_dead_state ++] = w;
+  }
+}
+
+static void ir_remove_dead(void) {
+  nr_live_scratch = 0;
+  nr_dead_state = 0;
+  scratch_overflow = false;
+
+  int i;
+  for (i = nr_ir - 1; i >= 0; i --) {
+    JitIR *e = &ir_buf[i];
+    switch (e->type) {
+      case IR_CALL: case IR_EXIT_CHECK:
+        // the guest state is all live when leaving the block, and the
+        // interpreter does not read scratch before writing it
+        nr_dead_state = 0;
+        continue;
+      case IR_LI: case IR_MV: case IR_ALU: case IR_SHIFT: case IR_MUL_LO:
+      case IR_HOST_LM: case IR_SETRELOP: case IR_HOST_SM:
+        if (!is_live(e->dest)) { e->type = IR_NOP; continue; }
+        break;
+      case IR_MULDIV:
+        // a division may trap, keep it
+        if (e->ext < 6 && !is_live(e->dest)) { e->type = IR_NOP; continue; }
+        break;
+    }
+
+    if (e->dest != NULL) mark_written(e->dest, e->type == IR_HOST_SM ? e->len : 4);
+    if (e->src1 != NULL) mark_read(e->src1, e->type == IR_HOST_LM ? e->len : 4);
+    if (e->src2 != NULL) mark_read(e->src2, 4);
+  }
+}
+
+/* host code emission */
+
+static inline void emit8(uint8_t x) { *code_ptr ++ = x; }
+static inline void emit32(uint32_t x) { memcpy(code_ptr, &x, 4); code_ptr += 4; }
+static inline void emit64(uint64_t x) { memcpy(code_ptr, &x, 8); code_ptr += 8; }
+
+/* op r32, [rbx + disp32] */
+static inline void emit_op_rm(uint8_t opcode, int r, const void *p) {
+  emit8(opcode);
+  emit8(0x83 | (r << 3));
+  emit32(jit_disp(p));
+}
+
+static inline void emit_load(int r, const void *p) { emit_op_rm(0x8b, r, p); }
+static inline void emit_store(int r, void *p) { emit_op_rm(0x89, r, p); }
+
+/* mov dword [rbx + disp32], imm32 */
+static inline void emit_store_imm(void *p, uint32_t imm) {
+  emit8(0xc7); emit8(0x83); emit32(jit_disp(p)); emit32(imm);
+}
+
+static inline void emit_call(const void *fn) {
+  // movabs rax, fn; call rax
+  emit8(0x48); emit8(0xb8); emit64((uintptr_t)fn);
+  emit8(0xff); emit8(0xd0);
+}
+
+static inline void emit_ret(uint32_t nr_done) {
+  emit8(0xb8); emit32(nr_done);                       // mov eax, nr_done
+  emit8(0x5b);                                        // pop rbx
+  emit8(0xc3);                                        // ret
+}
+
+/* the condition code of setcc/jcc for each relop */
+static int relop_cc(uint32_t relop) {
+  switch (relop) {
+    case RELOP_EQ: return 0x4;
+    case RELOP_NE: return 0x5;
+    case RELOP_LT: return 0xc;
+    case RELOP_LE: return 0xe;
+    case RELOP_GT: return 0xf;
+    case RELOP_GE: return 0xd;
+    case RELOP_LTU: return 0x2;
+    case RELOP_LEU: return 0x6;
+    case RELOP_GTU: return 0x7;
+    case RELOP_GEU: return 0x3;
+    default: panic("unsupport relop = %d", relop);
+  }
+}
+
+/* al <- relop(*src1, *src2) */
+static void emit_relop(uint32_t relop, const rtlreg_t *src1, const rtlreg_t *src2) {
+  if (relop == RELOP_FALSE || relop == RELOP_TRUE) {
+    emit8(0xb0); emit8(relop == RELOP_TRUE);          // mov al, imm8
+    return;
+  }
+  emit_load(EAX, src1);
+  emit_op_rm(0x3b, EAX, src2);                        // cmp eax, [src2]
+  emit8(0x0f); emit8(0x90 | relop_cc(relop)); emit8(0xc0);  // setcc al
+}
+
+static void ir_emit(JitIR *e) {
+  switch (e->type) {
+    case IR_NOP: break;
+    case IR_LI: emit_store_imm(e->dest, e->imm); break;
+    case IR_MV:
+      emit_load(EAX, e->src1);
+      emit_store(EAX, e->dest);
+      break;
+    case IR_ALU:
+      emit_load(EAX, e->src1);
+      emit_op_rm(e->opcode, EAX, e->src2);
+      emit_store(EAX, e->dest);
+      break;
+    case IR_SHIFT:
+      emit_load(EAX, e->src1);
+      emit_load(ECX, e->src2);
+      emit8(0xd3); emit8(0xc0 | (e->ext << 3));       // shift eax, cl
+      emit_store(EAX, e->dest);
+      break;
+    case IR_MUL_LO:
+      emit_load(EAX, e->src1);
+      emit8(0x0f); emit_op_rm(0xaf, EAX, e->src2);    // imul eax, [src2]
+      emit_store(EAX, e->dest);
+      break;
+    case IR_MULDIV:
+      emit_load(EAX, e->src1);
+      if (e->ext == 6) { emit8(0x31); emit8(0xd2); } // xor edx, edx
+      else if (e->ext == 7) { emit8(0x99); }          // cdq
+      emit_op_rm(0xf7, e->ext, e->src2);
+      emit_store(e->opcode, e->dest);
+      break;
+    case IR_LM:
+      emit_load(EDI, e->src1);
+      emit8(0xbe); emit32(e->len);                    // mov esi, len
+      emit_call(vaddr_read);
+      emit_store(EAX, e->dest);
+      break;
+    case IR_SM:
+      emit_load(EDI, e->src1);
+      emit_load(ESI, e->src2);
+      emit8(0xba); emit32(e->len);                    // mov edx, len
+      emit_call(vaddr_write);
+      break;
+    case IR_HOST_LM:
+      switch (e->len) {
+        case 4: emit_load(EAX, e->src1); break;
+        case 1: emit8(0x0f); emit_op_rm(0xb6, EAX, e->src1); break;  // movzx eax, byte
+        case 2: emit8(0x0f); emit_op_rm(0xb7, EAX, e->src1); break;  // movzx eax, word
+      }
+      emit_store(EAX, e->dest);
+      break;
+    case IR_HOST_SM:
+      emit_load(EAX, e->src1);
+      switch (e->len) {
+        case 4: emit_store(EAX, e->dest); break;
+        case 1: emit_op_rm(0x88, EAX, e->dest); break;
+        case 2: emit8(0x66); emit_store(EAX, e->dest); break;
+      }
+      break;
+    case IR_SETRELOP:
+      emit_relop(e->relop, e->src1, e->src2);
+      emit8(0x0f); emit8(0xb6); emit8(0xc0);          // movzx eax, al
+      emit_store(EAX, e->dest);
+      break;
+    case IR_J:
+      emit_store_imm(&cpu.pc, e->imm);
+      emit8(0xc6); emit8(0x83); emit32(jit_disp(&decinfo.is_jmp)); emit8(1);
+      break;
+    case IR_JR:
+      emit_load(EAX, e->src1);
+      emit_store(EAX, &cpu.pc);
+      emit8(0xc6); emit8(0x83); emit32(jit_disp(&decinfo.is_jmp)); emit8(1);
+      break;
+    case IR_JRELOP:
+      emit_relop(e->relop, e->src1, e->src2);
+      emit_op_rm(0x88, EAX, &decinfo.is_jmp);         // mov [is_jmp], al
+      emit8(0x84); emit8(0xc0);                       // test al, al
+      emit8(0x74); emit8(10);                         // jz +10
+      emit_store_imm(&cpu.pc, e->imm);
+      break;
+    case IR_CALL:
+      emit8(0x48); emit8(0xbf); emit64((uintptr_t)e->arg);  // movabs rdi, arg
+      emit_call(e->fn);
+      break;
+    case IR_EXIT_CHECK:
+      emit_op_rm(0x8a, EAX, &decinfo.is_jmp);         // mov al, [is_jmp]
+      emit_op_rm(0x0a, EAX, e->src1);                 // or al, [flag]
+      emit8(0x74); emit8(7);                          // jz +7
+      emit_ret(e->imm);
+      break;
+    default: assert(0);
+  }
+}
+
+/* translation of blocks */
+
+bool jit_block_begin(void) {
+  if (code_ptr + (JIT_NR_IR + 1) * JIT_IR_CODE_SIZE > code_buf + JIT_CODE_SIZE) return false;
+  nr_ir = 0;
+  return true;
+}
+
+void jit_instr_begin(void) {
+  instr_ir_start = nr_ir;
+  instr_fail = false;
+  instr_may_exit = false;
+  jit_emitting = true;
+}
+
+/* Return false if the instruction can not be translated. Its IR is
+ * discarded, and it should be interpreted with jit_instr_call(). */
+bool jit_instr_end(void) {
+  jit_emitting = false;
+  if (instr_fail) {
+    nr_ir = instr_ir_start;
+    instr_may_exit = false;
+    return false;
+  }
+  return true;
+}
+
+void jit_instr_call(void (*fn)(void *), void *arg) {
+  assert(nr_ir < JIT_NR_IR);
+  JitIR *e = &ir_buf[nr_ir ++];
+  e->type = IR_CALL;
+  e->dest = NULL;
+  e->src1 = e->src2 = NULL;
+  e->fn = fn;
+  e->arg = arg;
+  instr_may_exit = true;
+}
+
+/* Leave the block after `nr_done' instructions if the instruction
+ * jumps or `*flag' is set. */
+void jit_instr_exit_check(const bool *flag, uint32_t nr_done) {
+  if (!instr_may_exit) return;
+  assert(nr_ir < JIT_NR_IR);
+  JitIR *e = &ir_buf[nr_ir ++];
+  e->type = IR_EXIT_CHECK;
+  e->dest = NULL;
+  e->src1 = flag;
+  e->src2 = NULL;
+  e->imm = nr_done;
+}
+
+JitCode jit_block_end(uint32_t nr_instr) {
+  ir_remove_dead();
+
+  JitCode code = (JitCode)code_ptr;
+  emit8(0x53);                                        // push rbx
+  emit8(0x48); emit8(0xbb); emit64((uintptr_t)&cpu);  // movabs rbx, &cpu
+  int i;
+  for (i = 0; i < nr_ir; i ++) {
+    ir_emit(&ir_buf[i]);
+  }
+  emit_ret(nr_instr);
+  return code;
+}
@@ -1,44 +1,55 @@
 #include "common.h"
 
+void init_map();
 void init_argsrom();
 
 #ifdef HAS_IOE
 
-#include <sys/time.h>
-#include <signal.h>
+#include "device/event.h"
+#include <time.h>
 #include <SDL2/SDL.h>
 
 #define TIMER_HZ 100
 #define VGA_HZ 50
 
-static struct itimerval it = {};
-static int device_update_flag = false;
+/* Devices are polled by an event after every this many guest instructions. */
+#define DEVICE_POLL_INTERVAL 65536
 
 void init_serial();
 void init_timer();
-void init_vga();
+void init_vga(bool headless, char *frame_file, int frame_every, bool frame_hash);
 void init_i8042();
 
 void timer_intr();
 void send_key(uint8_t, bool);
+bool vga_poll_event(SDL_Event *);
 
-static void timer_sig_handler(int signum) {
-  timer_intr();
+/* host time of the next timer interrupt, in microseconds */
+static uint64_t next_tick = 0;
 
-  device_update_flag = true;
+static uint64_t host_time_us() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000ull + now.tv_nsec / 1000;
+}
 
-  int ret = setitimer(ITIMER_VIRTUAL, &it, NULL);
-  Assert(ret == 0, "Can not set timer");
+/* the timer interrupt with icount */
+static void timer_tick(uint32_t arg) {
+  timer_intr();
+  event_add(icount_us_to_instr(1000000 / TIMER_HZ), timer_tick, 0);
 }
 
-void device_update() {
-  if (!device_update_flag) {
-    return;
+static void device_poll(uint32_t arg) {
+  uint64_t now = host_time_us();
+  if (!icount_enabled() && now >= next_tick) {
+    timer_intr();
+    next_tick += 1000000 / TIMER_HZ;
+    // do not catch up after the emulation was paused
+    if (next_tick <= now) next_tick = now + 1000000 / TIMER_HZ;
   }
-  device_update_flag = false;
 
   SDL_Event event;
-  while (SDL_PollEvent(&event)) {
+  while (vga_poll_event(&event)) {
     switch (event.type) {
       case SDL_QUIT: {
                        void monitor_statistic();
@@ -57,34 +68,33 @@ void device_update() {
       default: break;
     }
   }
+
+  event_add(DEVICE_POLL_INTERVAL, device_poll, 0);
 }
 
 void sdl_clear_event_queue() {
   SDL_Event event;
-  while (SDL_PollEvent(&event));
+  while (vga_poll_event(&event));
 }
 
-void init_device() {
+void init_device(bool headless, char *frame_file, int frame_every, bool frame_hash) {
+  init_map();
   init_argsrom();
   init_serial();
   init_timer();
-  init_vga();
+  init_vga(headless, frame_file, frame_every, frame_hash);
   init_i8042();
 
-  struct sigaction s;
-  memset(&s, 0, sizeof(s));
-  s.sa_handler = timer_sig_handler;
-  int ret = sigaction(SIGVTALRM, &s, NULL);
-  Assert(ret == 0, "Can not set signal handler");
-
-  it.it_value.tv_sec = 0;
-  it.it_value.tv_usec = 1000000 / TIMER_HZ;
-  ret = setitimer(ITIMER_VIRTUAL, &it, NULL);
-  Assert(ret == 0, "Can not set timer");
+  next_tick = host_time_us() + 1000000 / TIMER_HZ;
+  event_add(DEVICE_POLL_INTERVAL, device_poll, 0);
+  if (icount_enabled()) {
+    event_add(icount_us_to_instr(1000000 / TIMER_HZ), timer_tick, 0);
+  }
 }
 #else
 
-void init_device() {
+void init_device(bool headless, char *frame_file, int frame_every, bool frame_hash) {
+  init_map();
   init_argsrom();
 }
 
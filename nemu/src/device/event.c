@@ -0,0 +1,107 @@
+#include "device/event.h"
+#include "monitor/snapshot.h"
+
+#define NR_EVENT 16
+#define NR_CALLBACK 8
+#define NIL (-1)
+
+/* The queue is saved in snapshots as it is, so it holds no host pointers.
+ * Events are linked by their indices in the pool, and a callback is kept
+ * as its index in `callbacks'. Indices of callbacks follow the order in
+ * which they are first scheduled, which the device initialization fixes
+ * before a snapshot can be loaded. `when' is the absolute number of guest
+ * instructions, which is saved along with the queue. */
+
+typedef struct {
+  uint64_t when;
+  int callback;
+  uint32_t arg;
+  int next;
+} Event;
+
+static struct {
+  Event pool[NR_EVENT];
+  int head, free;
+} q;
+
+static event_callback_t callbacks[NR_CALLBACK];
+static int nr_callback = 0;
+
+uint64_t event_deadline = UINT64_MAX;
+
+static inline void update_deadline(void) {
+  event_deadline = (q.head != NIL ? q.pool[q.head].when : UINT64_MAX);
+}
+
+static int callback_id(event_callback_t callback) {
+  int i;
+  for (i = 0; i < nr_callback; i ++) {
+    if (callbacks[i] == callback) return i;
+  }
+  Assert(nr_callback < NR_CALLBACK, "too many event callbacks");
+  callbacks[nr_callback] = callback;
+  return nr_callback ++;
+}
+
+static void event_loaded(void) {
+  int i;
+  for (i = q.head; i != NIL; i = q.pool[i].next) {
+    Assert(q.pool[i].callback < nr_callback, "the snapshot has an unknown event callback");
+  }
+  update_deadline();
+}
+
+void init_event(void) {
+  int i;
+  for (i = 0; i < NR_EVENT - 1; i ++) q.pool[i].next = i + 1;
+  q.pool[NR_EVENT - 1].next = NIL;
+  q.free = 0;
+  q.head = NIL;
+
+  snapshot_register("events", &q, sizeof(q), event_loaded);
+}
+
+/* Schedule `callback' to run after `delay' guest instructions. */
+void event_add(uint64_t delay, event_callback_t callback, uint32_t arg) {
+  int e = q.free;
+  Assert(e != NIL, "too many pending events");
+  q.free = q.pool[e].next;
+  q.pool[e] = (Event) { .when = guest_instr_now() + delay,
+    .callback = callback_id(callback), .arg = arg };
+
+  // keep the list sorted by time, and events at the same time in order
+  int *p = &q.head;
+  while (*p != NIL && q.pool[*p].when <= q.pool[e].when) p = &q.pool[*p].next;
+  q.pool[e].next = *p;
+  *p = e;
+
+  update_deadline();
+}
+
+/* Move the pending events `delta' instructions earlier, as if the time
+ * had passed. */
+void event_warp(uint64_t delta) {
+  uint64_t now = guest_instr_now();
+  int i;
+  for (i = q.head; i != NIL; i = q.pool[i].next) {
+    Event *e = &q.pool[i];
+    e->when = (e->when > now + delta ? e->when - delta : now);
+  }
+  update_deadline();
+}
+
+/* Run the events which are due. */
+void event_run(void) {
+  while (q.head != NIL && q.pool[q.head].when <= g_nr_guest_instr) {
+    int e = q.head;
+    q.head = q.pool[e].next;
+    event_callback_t callback = callbacks[q.pool[e].callback];
+    uint32_t arg = q.pool[e].arg;
+    q.pool[e].next = q.free;
+    q.free = e;
+    // the callback may schedule new events
+    callback(arg);
+  }
+
+  update_deadline();
+}
@@ -0,0 +1,74 @@
+#include "device/event.h"
+#include "monitor/snapshot.h"
+#include <unistd.h>
+
+/* With icount, guest time is derived from the number of instructions
+ * executed instead of the host clock, so that runs are reproducible.
+ * With warping, a guest which polls the clock is moved forward to the
+ * next millisecond instead of spinning through it.
+ */
+
+/* a clock read within this many instructions after the last one is polling */
+#define POLL_WINDOW 1024
+
+/* how long to sleep when the guest is idle without icount */
+#define IDLE_SLEEP_US 1000
+
+static uint64_t ipus = 0;  // guest instructions per microsecond, 0 if disabled
+static bool warp = false;
+static uint64_t nr_warped = 0;
+static uint64_t last_read = 0;
+
+void init_icount(int instr_per_us, bool enable_warp) {
+  // the virtual time goes with the guest instructions in a snapshot
+  snapshot_register("icount_warped", &nr_warped, sizeof(nr_warped), NULL);
+  snapshot_register("icount_read", &last_read, sizeof(last_read), NULL);
+
+  if (instr_per_us <= 0) return;
+  ipus = instr_per_us;
+  warp = enable_warp;
+  Log("icount: %d instructions per microsecond%s", instr_per_us, (warp ? ", warping" : ""));
+}
+
+bool icount_enabled(void) {
+  return ipus != 0;
+}
+
+uint64_t icount_us_to_instr(uint64_t us) {
+  return us * ipus;
+}
+
+uint64_t icount_time_us(void) {
+  return (guest_instr_now() + nr_warped) / ipus;
+}
+
+static inline void icount_skip(uint64_t delta) {
+  nr_warped += delta;
+  event_warp(delta);
+}
+
+/* Called when the guest reads the clock. */
+void icount_clock_read(void) {
+  uint64_t now = guest_instr_now();
+  if (warp && now - last_read < POLL_WINDOW) {
+    uint64_t per_ms = ipus * 1000;
+    icount_skip(per_ms - (now + nr_warped) % per_ms);
+  }
+  last_read = now;
+}
+
+/* Called when the guest is found spinning on a device register, which
+ * can only change at the next event. With icount, the virtual time skips
+ * to that event. Otherwise, the host sleeps a little before the event
+ * is run, instead of spinning as well. */
+void icount_idle(void) {
+  uint64_t now = guest_instr_now();
+  if (event_deadline == UINT64_MAX || event_deadline <= now) return;
+
+  uint64_t delta = event_deadline - now;
+  if (ipus != 0) icount_skip(delta);
+  else {
+    usleep(IDLE_SLEEP_US);
+    event_warp(delta);
+  }
+}
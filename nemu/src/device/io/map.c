@@ -1,12 +1,17 @@
 #include "memory/memory.h"
 #include "device/map.h"
 #include "nemu.h"
+#include "monitor/snapshot.h"
 
 #define IO_SPACE_MAX (1024 * 1024)
 
 static uint8_t io_space[IO_SPACE_MAX] PG_ALIGN = {};
 static uint8_t *p_space = io_space;
 
+void init_map(void) {
+  snapshot_register("io_space", io_space, IO_SPACE_MAX, NULL);
+}
+
 uint8_t* new_space(int size) {
   uint8_t *p = p_space;
   // page aligned;
@@ -45,3 +50,44 @@ void map_write(paddr_t addr, uint32_t data, int len, IOMap *map) {
 
   invoke_callback(map->callback, offset, len, true);
 }
+
+/* Block accesses of `len' bytes inside a map. Without a block callback,
+ * they are split into word accesses so that `callback' sees each of them. */
+void map_read_block(paddr_t addr, void *buf, int len, IOMap *map) {
+  check_bound(map, addr);
+  check_bound(map, addr + len - 1);
+  uint32_t offset = addr - map->low;
+
+  if (map->callback != NULL && map->block_callback == NULL) {
+    int i, n;
+    for (i = 0; i < len; i += n) {
+      n = (len - i < 4 ? len - i : 4);
+      uint32_t data = map_read(addr + i, n, map);
+      memcpy(buf + i, &data, n);
+    }
+    return;
+  }
+
+  invoke_callback(map->block_callback, offset, len, false);
+  memcpy(buf, map->space + offset, len);
+}
+
+void map_write_block(paddr_t addr, const void *buf, int len, IOMap *map) {
+  check_bound(map, addr);
+  check_bound(map, addr + len - 1);
+  uint32_t offset = addr - map->low;
+
+  if (map->callback != NULL && map->block_callback == NULL) {
+    int i, n;
+    for (i = 0; i < len; i += n) {
+      n = (len - i < 4 ? len - i : 4);
+      uint32_t data = 0;
+      memcpy(&data, buf + i, n);
+      map_write(addr + i, data, n, map);
+    }
+    return;
+  }
+
+  memcpy(map->space + offset, buf, len);
+  invoke_callback(map->block_callback, offset, len, true);
+}
@@ -1,23 +1,56 @@
 #include "common.h"
+#include "memory/memory.h"
 #include "device/map.h"
+#include <stdlib.h>
 
-#define NR_MAP 8
+/* MMIO maps are looked up by page. A page shared by several maps has a
+ * table which gives the map of each byte in it. */
+static IOMap *mmio_page[PMAP_NR_PAGE] = {};
+static IOMap **mmio_shared[PMAP_NR_PAGE] = {};
 
-static IOMap maps[NR_MAP] = {};
-static int nr_map = 0;
+static void mmio_share_page(uint32_t p) {
+  IOMap *old = mmio_page[p];
+  IOMap **t = calloc(PAGE_SIZE, sizeof(IOMap *));
+  assert(t != NULL);
+  int i;
+  for (i = 0; i < PAGE_SIZE; i ++) {
+    if (old != NULL && map_inside(old, p * PAGE_SIZE + i)) t[i] = old;
+  }
+  mmio_shared[p] = t;
+  mmio_page[p] = NULL;
+}
 
 /* device interface */
-void add_mmio_map(char *name, paddr_t addr, uint8_t* space, int len, io_callback_t callback) {
-  assert(nr_map < NR_MAP);
-  maps[nr_map] = (IOMap){ .name = name, .low = addr, .high = addr + len - 1,
+IOMap* add_mmio_map(char *name, paddr_t addr, uint8_t* space, int len, io_callback_t callback) {
+  IOMap *map = malloc(sizeof(IOMap));
+  assert(map != NULL);
+  *map = (IOMap){ .name = name, .low = addr, .high = addr + len - 1,
     .space = space, .callback = callback };
-  Log("Add mmio map '%s' at [0x%08x, 0x%08x]", maps[nr_map].name, maps[nr_map].low, maps[nr_map].high);
+  Log("Add mmio map '%s' at [0x%08x, 0x%08x]", map->name, map->low, map->high);
+
+  uint32_t p;
+  for (p = map->low / PAGE_SIZE; p <= map->high / PAGE_SIZE; p ++) {
+    Assert(pmap_host[p] == NULL, "mmio map '%s' overlaps pmem", map->name);
+    if (mmio_page[p] == NULL && mmio_shared[p] == NULL) {
+      mmio_page[p] = map;
+      continue;
+    }
+
+    if (mmio_shared[p] == NULL) mmio_share_page(p);
+    paddr_t a = (p * PAGE_SIZE < map->low ? map->low : p * PAGE_SIZE);
+    for (; a <= map->high && a / PAGE_SIZE == p; a ++) {
+      Assert(mmio_shared[p][a & PAGE_MASK] == NULL, "mmio map '%s' overlaps at 0x%08x", map->name, a);
+      mmio_shared[p][a & PAGE_MASK] = map;
+    }
+  }
 
-  nr_map ++;
+  return map;
 }
 
 /* bus interface */
 IOMap* fetch_mmio_map(paddr_t addr) {
-  int mapid = find_mapid_by_addr(maps, nr_map, addr);
-  return (mapid == -1 ? NULL : &maps[mapid]);
+  IOMap *map = mmio_page[addr / PAGE_SIZE];
+  if (map != NULL) return map;
+  IOMap **t = mmio_shared[addr / PAGE_SIZE];
+  return (t != NULL ? t[addr & PAGE_MASK] : NULL);
 }
@@ -1,35 +1,45 @@
 #include "common.h"
 #include "device/map.h"
+#include <stdlib.h>
 
 #define PORT_IO_SPACE_MAX 65535
 
-#define NR_MAP 8
-static IOMap maps[NR_MAP] = {};
-static int nr_map = 0;
+/* the map of each port */
+static IOMap *port_map[PORT_IO_SPACE_MAX + 1] = {};
 
 /* device interface */
-void add_pio_map(char *name, ioaddr_t addr, uint8_t *space, int len, io_callback_t callback) {
-  assert(nr_map < NR_MAP);
+IOMap* add_pio_map(char *name, ioaddr_t addr, uint8_t *space, int len, io_callback_t callback) {
   assert(addr + len <= PORT_IO_SPACE_MAX);
-  maps[nr_map] = (IOMap){ .name = name, .low = addr, .high = addr + len - 1,
+  IOMap *map = malloc(sizeof(IOMap));
+  assert(map != NULL);
+  *map = (IOMap){ .name = name, .low = addr, .high = addr + len - 1,
     .space = space, .callback = callback };
-  Log("Add port-io map '%s' at [0x%08x, 0x%08x]", maps[nr_map].name, maps[nr_map].low, maps[nr_map].high);
+  Log("Add port-io map '%s' at [0x%08x, 0x%08x]", map->name, map->low, map->high);
 
-  nr_map ++;
+  int i;
+  for (i = 0; i < len; i ++) {
+    Assert(port_map[addr + i] == NULL, "port-io map '%s' overlaps at 0x%04x", map->name, addr + i);
+    port_map[addr + i] = map;
+  }
+
+  return map;
 }
 
-static inline uint32_t pio_read_common(ioaddr_t addr, int len) {
+static inline IOMap* fetch_pio_map(ioaddr_t addr, int len) {
   assert(addr + len - 1 < PORT_IO_SPACE_MAX);
-  int mapid = find_mapid_by_addr(maps, nr_map, addr);
-  assert(mapid != -1);
-  return map_read(addr, len, &maps[mapid]);
+  IOMap *map = port_map[addr];
+  assert(map != NULL);
+  // the reference does not have the devices
+  difftest_skip_ref();
+  return map;
+}
+
+static inline uint32_t pio_read_common(ioaddr_t addr, int len) {
+  return map_read(addr, len, fetch_pio_map(addr, len));
 }
 
 static inline void pio_write_common(ioaddr_t addr, uint32_t data, int len) {
-  assert(addr + len - 1 < PORT_IO_SPACE_MAX);
-  int mapid = find_mapid_by_addr(maps, nr_map, addr);
-  assert(mapid != -1);
-  map_write(addr, data, len, &maps[mapid]);
+  map_write(addr, data, len, fetch_pio_map(addr, len));
 }
 
 /* CPU interface */
@@ -1,5 +1,6 @@
 #include "device/map.h"
 #include "monitor/monitor.h"
+#include "monitor/snapshot.h"
 #include <SDL2/SDL.h>
 
 #define I8042_DATA_PORT 0x60
@@ -63,4 +64,8 @@ void init_i8042() {
   i8042_data_port_base[0] = _KEY_NONE;
   add_pio_map("keyboard", I8042_DATA_PORT, (void *)i8042_data_port_base, 4, i8042_data_io_handler);
   add_mmio_map("keyboard", I8042_DATA_MMIO, (void *)i8042_data_port_base, 4, i8042_data_io_handler);
+
+  snapshot_register("key_queue", key_queue, sizeof(key_queue), NULL);
+  snapshot_register("key_f", &key_f, sizeof(key_f), NULL);
+  snapshot_register("key_r", &key_r, sizeof(key_r), NULL);
 }
@@ -1,5 +1,6 @@
 #include "device/map.h"
 #include "monitor/monitor.h"
+#include "device/event.h"
 #include <sys/time.h>
 
 #define RTC_PORT 0x48   // Note that this is not the standard
@@ -16,7 +17,11 @@ static uint32_t *rtc_port_base = NULL;
 
 void rtc_io_handler(uint32_t offset, int len, bool is_write) {
   assert(offset == 0);
-  if (!is_write) {
+  if (!is_write && icount_enabled()) {
+    icount_clock_read();
+    rtc_port_base[0] = icount_time_us() / 1000;
+  }
+  else if (!is_write) {
     struct timeval now;
     gettimeofday(&now, NULL);
     uint32_t seconds = now.tv_sec;
@@ -3,7 +3,9 @@
 #ifdef HAS_IOE
 
 #include "device/map.h"
+#include "monitor/snapshot.h"
 #include <SDL2/SDL.h>
+#include <inttypes.h>
 
 #define VMEM 0xa0000000
 
@@ -14,41 +16,211 @@
 #define SCREEN_H 300
 #define SCREEN_W 400
 
-static SDL_Window *window = NULL;
-static SDL_Renderer *renderer = NULL;
-static SDL_Texture *texture = NULL;
+/* The screen is presented by a render thread, which owns everything of
+ * SDL, since SDL wants the window, the rendering and the events on one
+ * thread. Stores to vmem mark the scanlines they touch. At a sync, the
+ * dirty scanlines are copied to `frame' and handed to the render thread,
+ * which uploads only them to the texture. Input events are passed back
+ * to the emulation through `event_queue'.
+ *
+ * In headless mode, SDL is not used at all. Synced frames, or their
+ * hashes, can be dumped to a file in both modes.
+ */
 
 static uint32_t (*vmem) [SCREEN_W] = NULL;
 static uint32_t *screensize_port_base = NULL;
+static bool vmem_dirty[SCREEN_H];
+
+static bool headless = false;
+static FILE *frame_fp = NULL;
+static int frame_every = 1;
+static bool frame_hash = false;
+static uint64_t nr_sync = 0;
+
+static SDL_mutex *vga_lock = NULL;
+static SDL_cond *vga_cond = NULL;
+
+/* the last synced frame, protected by `vga_lock' */
+static uint32_t frame[SCREEN_H][SCREEN_W];
+static bool frame_dirty[SCREEN_H];
+static bool frame_ready = false;
+
+#define NR_EVENT 64
+static SDL_Event event_queue[NR_EVENT];
+static int event_head = 0, event_tail = 0;
+
+/* Append the frame as a PPM image, or its FNV-1a hash as a line. */
+static void dump_frame() {
+  int x, y;
+  if (frame_hash) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    uint8_t *p = (void *)vmem;
+    for (x = 0; x < SCREEN_H * SCREEN_W * sizeof(vmem[0][0]); x ++) {
+      hash = (hash ^ p[x]) * 0x100000001b3ull;
+    }
+    fprintf(frame_fp, "%" PRIu64 " %016" PRIx64 "\n", nr_sync, hash);
+  }
+  else {
+    static uint8_t line[SCREEN_W * 3];
+    fprintf(frame_fp, "P6\n%d %d\n255\n", SCREEN_W, SCREEN_H);
+    for (y = 0; y < SCREEN_H; y ++) {
+      for (x = 0; x < SCREEN_W; x ++) {
+        line[x * 3 + 0] = vmem[y][x] >> 16;
+        line[x * 3 + 1] = vmem[y][x] >> 8;
+        line[x * 3 + 2] = vmem[y][x];
+      }
+      fwrite(line, sizeof(line), 1, frame_fp);
+    }
+  }
+  fflush(frame_fp);
+}
 
 static inline void update_screen() {
-  SDL_UpdateTexture(texture, NULL, vmem, SCREEN_W * sizeof(vmem[0][0]));
-  SDL_RenderClear(renderer);
-  SDL_RenderCopy(renderer, texture, NULL, NULL);
-  SDL_RenderPresent(renderer);
+  nr_sync ++;
+  if (frame_fp != NULL && nr_sync % frame_every == 0) dump_frame();
+  if (headless) return;
+
+  SDL_LockMutex(vga_lock);
+  int y;
+  for (y = 0; y < SCREEN_H; y ++) {
+    if (vmem_dirty[y]) {
+      memcpy(frame[y], vmem[y], sizeof(frame[y]));
+      frame_dirty[y] = true;
+      vmem_dirty[y] = false;
+    }
+  }
+  frame_ready = true;
+  SDL_CondSignal(vga_cond);
+  SDL_UnlockMutex(vga_lock);
 }
 
 static void vga_io_handler(uint32_t offset, int len, bool is_write) {
-  // TODO: call `update_screen()` when writing to the sync register
-  TODO();
+  if (is_write && offset == SYNC_PORT - SCREEN_PORT) {
+    update_screen();
+  }
 }
 
-void init_vga() {
-  char title[128];
-  sprintf(title, "%s-NEMU", str(__ISA__));
+// vmem is restored with io_space, so redraw everything
+static void vga_loaded() {
+  memset(vmem_dirty, true, sizeof(vmem_dirty));
+}
+
+static void vmem_io_handler(uint32_t offset, int len, bool is_write) {
+  if (!is_write) return;
+
+  uint32_t y;
+  for (y = offset / sizeof(vmem[0]); y <= (offset + len - 1) / sizeof(vmem[0]) && y < SCREEN_H; y ++) {
+    vmem_dirty[y] = true;
+  }
+}
+
+/* Fetch an input event received by the render thread. */
+bool vga_poll_event(SDL_Event *event) {
+  if (headless) return false;
+
+  SDL_LockMutex(vga_lock);
+  bool ok = (event_head != event_tail);
+  if (ok) {
+    *event = event_queue[event_head];
+    event_head = (event_head + 1) % NR_EVENT;
+  }
+  SDL_UnlockMutex(vga_lock);
+  return ok;
+}
+
+static int vga_render_thread(void *arg) {
+  SDL_Window *window = NULL;
+  SDL_Renderer *renderer = NULL;
+  SDL_Texture *texture = NULL;
+  static uint32_t shown[SCREEN_H][SCREEN_W];
+  bool dirty[SCREEN_H];
 
   SDL_Init(SDL_INIT_VIDEO);
   SDL_CreateWindowAndRenderer(SCREEN_W * 2, SCREEN_H * 2, 0, &window, &renderer);
-  SDL_SetWindowTitle(window, title);
+  SDL_SetWindowTitle(window, arg);
   texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
       SDL_TEXTUREACCESS_STATIC, SCREEN_W, SCREEN_H);
 
+  while (true) {
+    SDL_LockMutex(vga_lock);
+    // wake up from time to time to receive events
+    if (!frame_ready) SDL_CondWaitTimeout(vga_cond, vga_lock, 10);
+    bool ready = frame_ready;
+    int y;
+    for (y = 0; y < SCREEN_H; y ++) {
+      dirty[y] = ready && frame_dirty[y];
+      if (dirty[y]) {
+        memcpy(shown[y], frame[y], sizeof(shown[y]));
+        frame_dirty[y] = false;
+      }
+    }
+    frame_ready = false;
+    SDL_UnlockMutex(vga_lock);
+
+    if (ready) {
+      // upload each run of dirty scanlines
+      for (y = 0; y < SCREEN_H; ) {
+        if (!dirty[y]) { y ++; continue; }
+        int y0 = y;
+        while (y < SCREEN_H && dirty[y]) y ++;
+        SDL_Rect rect = { .x = 0, .y = y0, .w = SCREEN_W, .h = y - y0 };
+        SDL_UpdateTexture(texture, &rect, shown[y0], sizeof(shown[0]));
+      }
+      SDL_RenderClear(renderer);
+      SDL_RenderCopy(renderer, texture, NULL, NULL);
+      SDL_RenderPresent(renderer);
+    }
+
+    SDL_Event event;
+    while (SDL_PollEvent(&event)) {
+      if (event.type != SDL_QUIT && event.type != SDL_KEYDOWN && event.type != SDL_KEYUP) continue;
+      SDL_LockMutex(vga_lock);
+      int next = (event_tail + 1) % NR_EVENT;
+      // drop the event if the emulation does not keep up
+      if (next != event_head) {
+        event_queue[event_tail] = event;
+        event_tail = next;
+      }
+      SDL_UnlockMutex(vga_lock);
+    }
+  }
+
+  return 0;
+}
+
+void init_vga(bool is_headless, char *frame_file, int every, bool hash) {
+  static char title[128];
+  sprintf(title, "%s-NEMU", str(__ISA__));
+
   screensize_port_base = (void *)new_space(8);
   screensize_port_base[0] = ((SCREEN_W) << 16) | (SCREEN_H);
   add_pio_map("screen", SCREEN_PORT, (void *)screensize_port_base, 8, vga_io_handler);
   add_mmio_map("screen", SCREEN_MMIO, (void *)screensize_port_base, 8, vga_io_handler);
 
   vmem = (void *)new_space(0x80000);
-  add_mmio_map("vmem", VMEM, (void *)vmem, 0x80000, NULL);
+  IOMap *map = add_mmio_map("vmem", VMEM, (void *)vmem, 0x80000, vmem_io_handler);
+  map->block_callback = vmem_io_handler;
+  memset(vmem_dirty, true, sizeof(vmem_dirty));
+  snapshot_add_hook(vga_loaded);
+
+  if (frame_file != NULL) {
+    frame_fp = fopen(frame_file, "wb");
+    Assert(frame_fp, "Can not open '%s'", frame_file);
+    frame_every = (every > 0 ? every : 1);
+    frame_hash = hash;
+    Log("Dump %s of every %d synced frame(s) to %s", (hash ? "hashes" : "images"), frame_every, frame_file);
+  }
+
+  headless = is_headless;
+  if (headless) {
+    Log("VGA: headless");
+    return;
+  }
+
+  vga_lock = SDL_CreateMutex();
+  vga_cond = SDL_CreateCond();
+  SDL_Thread *thread = SDL_CreateThread(vga_render_thread, "vga", title);
+  Assert(thread != NULL, "Can not create the render thread: %s", SDL_GetError());
+  SDL_DetachThread(thread);
 }
 #endif	/* HAS_IOE */
@@ -8,8 +8,6 @@ static inline make_DopHelper(i) {
   op->type = OP_TYPE_IMM;
   op->imm = val;
   rtl_li(&op->val, op->imm);
-
-  print_Dop(op->str, OP_STR_SIZE, "%d", op->imm);
 }
 
 static inline make_DopHelper(r) {
@@ -18,25 +16,20 @@ static inline make_DopHelper(r) {
   if (load_val) {
     rtl_lr(&op->val, op->reg, 4);
   }
-
-  print_Dop(op->str, OP_STR_SIZE, "%s", reg_name(op->reg, 4));
 }
 
 make_DHelper(IU) {
   decode_op_r(id_src, decinfo.isa.instr.rs, true);
   decode_op_i(id_src2, decinfo.isa.instr.imm, true);
   decode_op_r(id_dest, decinfo.isa.instr.rt, false);
-
-  print_Dop(id_src2->str, OP_STR_SIZE, "0x%x", decinfo.isa.instr.imm);
 }
 
 static inline make_DHelper(addr) {
   decode_op_r(id_src, decinfo.isa.instr.rs, true);
   decode_op_i(id_src2, decinfo.isa.instr.simm, true);
 
-  print_Dop(id_src->str, OP_STR_SIZE, "%d(%s)", id_src2->val, reg_name(id_src->reg, 4));
-
   rtl_add(&id_src->addr, &id_src->val, &id_src2->val);
+  id_src->type = OP_TYPE_MEM;
 }
 
 make_DHelper(ld) {
@@ -48,3 +41,13 @@ make_DHelper(st) {
   decode_addr(NULL);
   decode_op_r(id_dest, decinfo.isa.instr.rt, true);
 }
+
+void isa_op_str(char *buf, size_t size, const Operand *op) {
+  switch (op->type) {
+    case OP_TYPE_REG: snprintf(buf, size, "%s", reg_name(op->reg, 4)); break;
+    case OP_TYPE_IMM: snprintf(buf, size, "%d", op->imm); break;
+    // the memory operand of loads and stores is the base register plus the offset in `src2'
+    case OP_TYPE_MEM: snprintf(buf, size, "%d(%s)", id_src2->val, reg_name(decinfo.isa.instr.rs, 4)); break;
+    default: snprintf(buf, size, "?");
+  }
+}
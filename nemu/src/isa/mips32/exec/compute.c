@@ -4,5 +4,5 @@ make_EHelper(lui) {
   rtl_shli(&s0, &id_src2->val, 16);
   rtl_sr(id_dest->reg, &s0, 4);
 
-  print_asm_template3(lui);
+  print_asm("lui %s,0x%x,%s", op_str(id_src), decinfo.isa.instr.imm, op_str(id_dest));
 }
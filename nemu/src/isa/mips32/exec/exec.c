@@ -1,5 +1,6 @@
 #include "cpu/exec.h"
 #include "all-instr.h"
+#include "monitor/watchpoint.h"
 
 static OpcodeEntry special_table [64] = {
   /* b000 */ EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY, EMPTY,
@@ -32,3 +33,11 @@ void isa_exec(vaddr_t *pc) {
   decinfo.width = opcode_table[decinfo.isa.instr.opcode].width;
   idex(pc, &opcode_table[decinfo.isa.instr.opcode]);
 }
+
+uint64_t isa_exec_blocks(uint64_t n) {
+  /* no translated blocks yet, execute one instruction each time */
+  vaddr_t exec_once(void);
+  if (bp_hit(cpu.pc)) return 0;
+  exec_once();
+  return 1;
+}
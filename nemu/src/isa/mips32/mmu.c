@@ -11,3 +11,10 @@ uint32_t isa_vaddr_read(vaddr_t addr, int len) {
 void isa_vaddr_write(vaddr_t addr, uint32_t data, int len) {
   paddr_write(va2pa(addr, true), data, len);
 }
+
+void isa_memory_changed(void) {
+}
+
+bool isa_paging_enabled(void) {
+  return false;
+}
@@ -10,6 +10,24 @@ const char *regsl[] = {
 void isa_reg_display() {
 }
 
+/* Return the address of the register named `s' (without `$'), and its
+ * width in bytes. */
+const void* isa_reg_str2addr(const char *s, int *width) {
+  int i;
+  *width = 4;
+  for (i = 0; i < 32; i ++) {
+    if (strcmp(s, regsl[i]) == 0) return &reg_l(i);
+  }
+  if (strcmp(s, "pc") == 0) return &cpu.pc;
+  return NULL;
+}
+
 uint32_t isa_reg_str2val(const char *s, bool *success) {
-  return 0;
+  int width;
+  const uint32_t *p = isa_reg_str2addr(s, &width);
+  if (p == NULL) {
+    *success = false;
+    return 0;
+  }
+  return *p;
 }
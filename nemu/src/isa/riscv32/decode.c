@@ -8,8 +8,6 @@ static inline make_DopHelper(i) {
   op->type = OP_TYPE_IMM;
   op->imm = val;
   rtl_li(&op->val, op->imm);
-
-  print_Dop(op->str, OP_STR_SIZE, "%d", op->imm);
 }
 
 static inline make_DopHelper(r) {
@@ -18,24 +16,19 @@ static inline make_DopHelper(r) {
   if (load_val) {
     rtl_lr(&op->val, op->reg, 4);
   }
-
-  print_Dop(op->str, OP_STR_SIZE, "%s", reg_name(op->reg, 4));
 }
 
 make_DHelper(U) {
   decode_op_i(id_src, decinfo.isa.instr.imm31_12 << 12, true);
   decode_op_r(id_dest, decinfo.isa.instr.rd, false);
-
-  print_Dop(id_src->str, OP_STR_SIZE, "0x%x", decinfo.isa.instr.imm31_12);
 }
 
 make_DHelper(ld) {
   decode_op_r(id_src, decinfo.isa.instr.rs1, true);
   decode_op_i(id_src2, decinfo.isa.instr.simm11_0, true);
 
-  print_Dop(id_src->str, OP_STR_SIZE, "%d(%s)", id_src2->val, reg_name(id_src->reg, 4));
-
   rtl_add(&id_src->addr, &id_src->val, &id_src2->val);
+  id_src->type = OP_TYPE_MEM;
 
   decode_op_r(id_dest, decinfo.isa.instr.rd, false);
 }
@@ -45,9 +38,18 @@ make_DHelper(st) {
   int32_t simm = (decinfo.isa.instr.simm11_5 << 5) | decinfo.isa.instr.imm4_0;
   decode_op_i(id_src2, simm, true);
 
-  print_Dop(id_src->str, OP_STR_SIZE, "%d(%s)", id_src2->val, reg_name(id_src->reg, 4));
-
   rtl_add(&id_src->addr, &id_src->val, &id_src2->val);
+  id_src->type = OP_TYPE_MEM;
 
   decode_op_r(id_dest, decinfo.isa.instr.rs2, true);
 }
+
+void isa_op_str(char *buf, size_t size, const Operand *op) {
+  switch (op->type) {
+    case OP_TYPE_REG: snprintf(buf, size, "%s", reg_name(op->reg, 4)); break;
+    case OP_TYPE_IMM: snprintf(buf, size, "%d", op->imm); break;
+    // the memory operand of loads and stores is the base register plus the offset in `src2'
+    case OP_TYPE_MEM: snprintf(buf, size, "%d(%s)", id_src2->val, reg_name(decinfo.isa.instr.rs1, 4)); break;
+    default: snprintf(buf, size, "?");
+  }
+}
@@ -3,5 +3,5 @@
 make_EHelper(lui) {
   rtl_sr(id_dest->reg, &id_src->val, 4);
 
-  print_asm_template2(lui);
+  print_asm("lui 0x%x,%s", decinfo.isa.instr.imm31_12, op_str(id_dest));
 }
@@ -1,5 +1,6 @@
 #include "cpu/exec.h"
 #include "all-instr.h"
+#include "monitor/watchpoint.h"
 
 static OpcodeEntry load_table [8] = {
   EMPTY, EMPTY, EXW(ld, 4), EMPTY, EMPTY, EMPTY, EMPTY, EMPTY
@@ -31,3 +32,11 @@ void isa_exec(vaddr_t *pc) {
   assert(decinfo.isa.instr.opcode1_0 == 0x3);
   idex(pc, &opcode_table[decinfo.isa.instr.opcode6_2]);
 }
+
+uint64_t isa_exec_blocks(uint64_t n) {
+  /* no translated blocks yet, execute one instruction each time */
+  vaddr_t exec_once(void);
+  if (bp_hit(cpu.pc)) return 0;
+  exec_once();
+  return 1;
+}
@@ -0,0 +1,293 @@
+#include "cache.h"
+#include "monitor/monitor.h"
+#include "rtl/jit.h"
+#include "device/event.h"
+#include "monitor/watchpoint.h"
+
+/* Translated blocks are straight-line runs of decoded instructions,
+ * recorded while they are executed for the first time. A block ends at
+ * the first instruction which jumps. An instruction in the middle of a
+ * block may still jump (e.g. a jcc which was not taken when recording),
+ * and the execution leaves the block there.
+ *
+ * Each block caches pointers to the blocks it was last followed by, so
+ * the dispatcher only looks up the block table when the successor changes.
+ *
+ * With the JIT enabled, a block executed JIT_THRESHOLD times is translated
+ * to host code.
+ *
+ * A block which loops to itself IDLE_THRESHOLD times, reading the same
+ * MMIO address without any store each time, is polling a device. The
+ * time is then skipped to the next device event.
+ *
+ * A breakpoint is checked when a block is entered, and a block ends
+ * before the PC of a breakpoint, so that each breakpoint starts a block.
+ */
+
+#define BC_NR_BLOCK 4096
+#define BC_NR_INSTR (16 * 1024)
+#define BLOCK_MAX_INSTR 64
+#define JIT_THRESHOLD 16
+#define IDLE_THRESHOLD 64
+
+/* Blocks are also listed by the page they start in (hashed), so that a
+ * store only checks the blocks near it. A block is shorter than a page,
+ * so it overlaps at most the page it starts in and the next one. */
+#define BC_PAGE_SHIFT 12
+#define BC_NR_PAGE 4096
+#define bc_page(addr) (((addr) >> BC_PAGE_SHIFT) % BC_NR_PAGE)
+
+typedef struct Block {
+  vaddr_t pc, end;
+  bool valid;
+  int nr_instr;
+  DecodedInstr *instr;
+  struct Block *succ[2];
+  int nr_exec;
+  JitCode code;
+  uint16_t next;   // index + 1 of the next block in the page list, 0 for none
+} Block;
+
+static Block bc_pool[BC_NR_BLOCK];
+static Block *bc_table[BC_NR_BLOCK];
+static uint16_t bc_page_head[BC_NR_PAGE];
+static DecodedInstr bc_instr_pool[BC_NR_INSTR];
+static int nr_block = 0, nr_instr = 0;
+
+/* set when some blocks are dropped during the execution of a block */
+static bool bc_stale = false;
+
+vaddr_t exec_once(void);
+
+void block_cache_flush(void) {
+  int i;
+  for (i = 0; i < nr_block; i ++) {
+    bc_pool[i].valid = false;
+  }
+  memset(bc_table, 0, sizeof(bc_table));
+  memset(bc_page_head, 0, sizeof(bc_page_head));
+  nr_block = 0;
+  nr_instr = 0;
+  bc_stale = true;
+  jit_flush();
+}
+
+static inline Block** bc_slot(vaddr_t pc) {
+  return &bc_table[(pc ^ (pc >> 12)) % BC_NR_BLOCK];
+}
+
+static void bc_invalidate_page(uint32_t page, vaddr_t addr, int len) {
+  uint16_t *link = &bc_page_head[page % BC_NR_PAGE];
+  while (*link != 0) {
+    Block *b = &bc_pool[*link - 1];
+    if (b->pc - addr < len || b->end - b->pc > addr - b->pc) {
+      b->valid = false;
+      if (*bc_slot(b->pc) == b) *bc_slot(b->pc) = NULL;
+      *link = b->next;
+      bc_stale = true;
+    }
+    else {
+      link = &b->next;
+    }
+  }
+}
+
+/* Drop the blocks which overlap [addr, addr + len). */
+void block_cache_invalidate(vaddr_t addr, int len) {
+  uint32_t page = (addr >> BC_PAGE_SHIFT) - 1;
+  uint32_t last = (addr + len - 1) >> BC_PAGE_SHIFT;
+  for (; page != last + 1; page ++) {
+    bc_invalidate_page(page, addr, len);
+  }
+}
+
+static inline Block* bc_lookup(vaddr_t pc) {
+  Block *b = *bc_slot(pc);
+  return (b != NULL && b->pc == pc ? b : NULL);
+}
+
+/* Execute from cpu.pc while recording a new block, with at most n instructions.
+ * Return the number of instructions executed. */
+static uint64_t bc_translate(uint64_t n) {
+  if (nr_block == BC_NR_BLOCK || nr_instr + BLOCK_MAX_INSTR > BC_NR_INSTR) {
+    decode_cache_flush();
+  }
+
+  Block *b = &bc_pool[nr_block ++];
+  b->pc = cpu.pc;
+  b->valid = false;
+  b->nr_instr = 0;
+  b->instr = &bc_instr_pool[nr_instr];
+  b->succ[0] = b->succ[1] = NULL;
+  b->nr_exec = 0;
+  b->code = NULL;
+
+  bc_stale = false;
+  uint64_t i;
+  for (i = 0; i < n && b->nr_instr < BLOCK_MAX_INSTR; ) {
+    vaddr_t pc = cpu.pc;
+    exec_once();
+    i ++;
+
+    if (bc_stale) {
+      // the code is modified, do not keep the block
+      if (nr_block > 0 && b == &bc_pool[nr_block - 1]) nr_block --;
+      return i;
+    }
+    DecodedInstr *d = decode_cache_lookup(pc);
+    if (d == NULL) {
+      // the instruction is not cached, end the block before it
+      if (b->nr_instr > 0) break;
+      nr_block --;
+      return i;
+    }
+    b->instr[b->nr_instr ++] = *d;
+
+    if (cpu.pc != d->info.seq_pc || nemu_state.state != NEMU_RUNNING || bp_is_set(cpu.pc)) break;
+  }
+
+  nr_instr += b->nr_instr;
+  b->end = b->instr[b->nr_instr - 1].info.seq_pc;
+  b->valid = true;
+  *bc_slot(b->pc) = b;
+  b->next = bc_page_head[bc_page(b->pc)];
+  bc_page_head[bc_page(b->pc)] = b - bc_pool + 1;
+  return i;
+}
+
+static void jit_interpret(void *arg) {
+  DecodedInstr *d = arg;
+  cpu.pc = d->pc;
+  decoded_instr_exec(d, &decinfo.seq_pc);
+}
+
+static void bc_jit(Block *b) {
+  if (!jit_block_begin()) {
+    // the code buffer is full
+    decode_cache_flush();
+    return;
+  }
+
+  CPU_state cpu_saved = cpu;
+  DecodeInfo decinfo_saved = decinfo;
+  int i;
+  for (i = 0; i < b->nr_instr; i ++) {
+    DecodedInstr *d = &b->instr[i];
+    cpu.pc = d->pc;
+    decinfo = d->info;
+    CPU_state cpu_before = cpu;
+
+    jit_instr_begin();
+    Operand *ops[] = { id_dest, id_src, id_src2 };
+    int j;
+    for (j = 0; j < 3; j ++) {
+      // immediates are not written at run time
+      if (ops[j]->type == OP_TYPE_IMM) { rtl_li(&ops[j]->val, ops[j]->val); }
+      replay_operand(ops[j]);
+    }
+    d->execute(&decinfo.seq_pc);
+
+    if (!jit_instr_end()) {
+      cpu = cpu_before;
+      jit_instr_call(jit_interpret, d);
+    }
+    else {
+      // a helper which does not opt out must only use RTL
+      Assert(memcmp(&cpu, &cpu_before, sizeof(cpu)) == 0,
+          "the helper of the instruction at pc = 0x%08x changes the state when translated", d->pc);
+    }
+    jit_instr_exit_check(&bc_stale, i + 1);
+  }
+  b->code = jit_block_end(b->nr_instr);
+
+  cpu = cpu_saved;
+  decinfo = decinfo_saved;
+}
+
+static inline uint64_t bc_exec(Block *b) {
+  bc_stale = false;
+  int i;
+
+  if (b->code != NULL) {
+    i = b->code();
+    if (decinfo.is_jmp) { decinfo.is_jmp = 0; }
+    else { cpu.pc = b->instr[i - 1].info.seq_pc; }
+    return i;
+  }
+
+  for (i = 0; i < b->nr_instr; ) {
+    DecodedInstr *d = &b->instr[i ++];
+    cpu.pc = d->pc;
+    decoded_instr_exec(d, &decinfo.seq_pc);
+    if (decinfo.is_jmp || bc_stale) break;
+  }
+
+  if (decinfo.is_jmp) { decinfo.is_jmp = 0; }
+  else { cpu.pc = decinfo.seq_pc; }
+
+  if (++ b->nr_exec == JIT_THRESHOLD && jit_enabled() && !bc_stale) {
+    bc_jit(b);
+  }
+  return i;
+}
+
+/* Execute at most n instructions with translated blocks, and translate
+ * new blocks on the way. Return the number of instructions executed. */
+uint64_t isa_exec_blocks(uint64_t n) {
+  uint64_t nr = 0;
+  Block *prev = NULL;
+  int nr_idle = 0;
+
+  while (nr < n) {
+    g_nr_slice_instr = nr;
+    if (bp_hit(cpu.pc)) break;
+
+    Block *b = NULL;
+    if (prev != NULL && !bc_stale) {
+      if (prev->succ[0] != NULL && prev->succ[0]->pc == cpu.pc && prev->succ[0]->valid) b = prev->succ[0];
+      else if (prev->succ[1] != NULL && prev->succ[1]->pc == cpu.pc && prev->succ[1]->valid) b = prev->succ[1];
+      else {
+        b = bc_lookup(cpu.pc);
+        if (b != NULL) {
+          prev->succ[1] = prev->succ[0];
+          prev->succ[0] = b;
+        }
+      }
+    }
+    else {
+      b = bc_lookup(cpu.pc);
+    }
+
+    if (b == NULL) {
+      nr += bc_translate(n - nr);
+      prev = NULL;
+    }
+    else if (b->nr_instr > n - nr) {
+      // not enough instructions left for the whole block
+      exec_once();
+      nr ++;
+      prev = NULL;
+    }
+    else {
+      uint64_t nr_read = nr_mmio_read, nr_write = nr_vaddr_write;
+      paddr_t read_addr = last_mmio_read;
+      nr += bc_exec(b);
+
+      bool idle = (b == prev && cpu.pc == b->pc && nr_mmio_read != nr_read &&
+          last_mmio_read == read_addr && nr_vaddr_write == nr_write);
+      nr_idle = (idle ? nr_idle + 1 : 0);
+      prev = b;
+      if (nr_idle == IDLE_THRESHOLD) {
+        g_nr_slice_instr = nr;
+        icount_idle();
+        break;
+      }
+    }
+
+    if (nemu_state.state != NEMU_RUNNING) break;
+  }
+
+  // the caller counts them from now on
+  g_nr_slice_instr = 0;
+  return nr;
+}
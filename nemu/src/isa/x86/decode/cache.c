@@ -0,0 +1,117 @@
+#include "cache.h"
+
+/* The decode cache remembers the decoding result of the instruction at
+ * a given pc, so that executing it again can skip instruction fetch and
+ * decode. Operand locations (registers, immediates and addressing modes)
+ * are kept, while operand values are reloaded from the current state.
+ */
+
+#define DC_NR_ENTRY 4096
+#define MAX_INSTR_LEN 15
+
+typedef struct {
+  bool valid;
+  DecodedInstr instr;
+#ifdef DEBUG
+  uint8_t instr_len;
+  uint8_t instr_bytes[ITRACE_MAX_INSTR];
+#endif
+} DCEntry;
+
+static DCEntry dc[DC_NR_ENTRY];
+
+/* nonzero if some cached instruction may lie in the line */
+uint8_t dc_code_line[DC_NR_LINE] = {};
+
+/* the entry being filled, NULL when not recording */
+static DCEntry *dc_fill = NULL;
+
+static inline DCEntry* dc_entry(vaddr_t pc) {
+  return &dc[pc % DC_NR_ENTRY];
+}
+
+void block_cache_flush(void);
+void block_cache_invalidate(vaddr_t addr, int len);
+
+void decode_cache_flush(void) {
+  int i;
+  for (i = 0; i < DC_NR_ENTRY; i ++) {
+    dc[i].valid = false;
+  }
+  memset(dc_code_line, 0, sizeof(dc_code_line));
+
+  // the instruction being decoded may have modified itself
+  dc_fill = NULL;
+
+  block_cache_flush();
+}
+
+/* Drop the cached instructions which overlap [addr, addr + len). They
+ * start at most MAX_INSTR_LEN - 1 bytes before `addr', so they are found
+ * by looking up each pc in between. */
+void decode_cache_invalidate(vaddr_t addr, int len) {
+  vaddr_t start = addr - (MAX_INSTR_LEN - 1), pc;
+  for (pc = start; pc != addr + len; pc ++) {
+    DCEntry *e = dc_entry(pc);
+    if (e->valid && e->instr.pc == pc &&
+        (pc - addr < len || e->instr.info.seq_pc - pc > addr - pc)) {
+      e->valid = false;
+    }
+  }
+
+  // the instruction being decoded may have modified itself
+  if (dc_fill != NULL && dc_fill->instr.pc - start < addr + len - start) dc_fill = NULL;
+
+  block_cache_invalidate(addr, len);
+}
+
+/* Execute the instruction at `*pc' with its cached decoding.
+ * Return false if it is not in the cache. */
+bool decode_cache_exec(vaddr_t *pc) {
+  DCEntry *e = dc_entry(*pc);
+  if (!e->valid || e->instr.pc != *pc) {
+    return false;
+  }
+
+#ifdef DEBUG
+  itrace_fetch(e->instr_bytes, e->instr_len);
+#endif
+  decoded_instr_exec(&e->instr, pc);
+  return true;
+}
+
+DecodedInstr* decode_cache_lookup(vaddr_t pc) {
+  DCEntry *e = dc_entry(pc);
+  return (e->valid && e->instr.pc == pc ? &e->instr : NULL);
+}
+
+void decode_cache_fill_begin(vaddr_t pc) {
+  dc_fill = dc_entry(pc);
+  dc_fill->valid = false;
+  dc_fill->instr.pc = pc;
+
+  decinfo.src.load_width = decinfo.dest.load_width = decinfo.src2.load_width = 0;
+}
+
+/* Called right before an execution helper runs. The last call during
+ * an instruction comes from the innermost opcode entry, whose helper
+ * and decoding result are what should be cached. */
+void decode_cache_record(EHelper execute) {
+  if (dc_fill != NULL) {
+    dc_fill->instr.execute = execute;
+    dc_fill->instr.info = decinfo;
+  }
+}
+
+void decode_cache_fill_end(vaddr_t seq_pc) {
+  if (dc_fill == NULL) return;
+
+  dc_code_line[dc_line(dc_fill->instr.pc)] = 1;
+  dc_code_line[dc_line(seq_pc - 1)] = 1;
+#ifdef DEBUG
+  dc_fill->instr_len = itrace_cur.len;
+  memcpy(dc_fill->instr_bytes, itrace_cur.instr, itrace_cur.len);
+#endif
+  dc_fill->valid = true;
+  dc_fill = NULL;
+}
@@ -0,0 +1,50 @@
+#ifndef __X86_DECODE_CACHE_H__
+#define __X86_DECODE_CACHE_H__
+
+#include "cpu/exec.h"
+
+/* the decoding result of an instruction */
+typedef struct {
+  vaddr_t pc;
+  EHelper execute;
+  DecodeInfo info;
+} DecodedInstr;
+
+DecodedInstr* decode_cache_lookup(vaddr_t pc);
+
+static inline void replay_operand(Operand *op) {
+  if (op->type == OP_TYPE_MEM) {
+    rtl_li(&s0, decinfo.isa.disp);
+    if (decinfo.isa.base_reg != -1) {
+      rtl_add(&s0, &s0, &reg_l(decinfo.isa.base_reg));
+    }
+    if (decinfo.isa.index_reg != -1) {
+      rtl_shli(&s1, &reg_l(decinfo.isa.index_reg), decinfo.isa.scale);
+      rtl_add(&s0, &s0, &s1);
+    }
+    rtl_mv(&op->addr, &s0);
+  }
+
+  if (op->load_width != 0) {
+    if (op->type == OP_TYPE_REG) { rtl_lr(&op->val, op->reg, op->load_width); }
+    else if (op->type == OP_TYPE_MEM) { rtl_lm(&op->val, &op->addr, op->load_width); }
+  }
+}
+
+/* Execute an instruction with its decoding result. Operand values
+ * are reloaded from the current machine state. */
+static inline void decoded_instr_exec(DecodedInstr *d, vaddr_t *pc) {
+  decinfo = d->info;
+  *pc = decinfo.seq_pc;
+
+  replay_operand(id_dest);
+  replay_operand(id_src);
+  replay_operand(id_src2);
+
+  d->execute(pc);
+
+  // the operand-size prefix is not executed again
+  decinfo.isa.is_operand_size_16 = false;
+}
+
+#endif
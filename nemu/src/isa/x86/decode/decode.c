@@ -11,8 +11,6 @@ static inline make_DopHelper(I) {
   op->type = OP_TYPE_IMM;
   op->imm = instr_fetch(pc, op->width);
   rtl_li(&op->val, op->imm);
-
-  print_Dop(op->str, OP_STR_SIZE, "$0x%x", op->imm);
 }
 
 /* I386 manual does not contain this abbreviation, but it is different from
@@ -25,17 +23,10 @@ static inline make_DopHelper(SI) {
 
   op->type = OP_TYPE_IMM;
 
-  /* TODO: Use instr_fetch() to read `op->width' bytes of memory
-   * pointed by 'pc'. Interpret the result as a signed immediate,
-   * and assign it to op->simm.
-   *
-   op->simm = ???
-   */
-  TODO();
+  op->simm = instr_fetch(pc, op->width);
+  if (op->width == 1) op->simm = (int8_t)op->simm;
 
   rtl_li(&op->val, op->simm);
-
-  print_Dop(op->str, OP_STR_SIZE, "$0x%x", op->simm);
 }
 
 /* I386 manual does not contain this abbreviation.
@@ -47,9 +38,8 @@ static inline make_DopHelper(a) {
   op->reg = R_EAX;
   if (load_val) {
     rtl_lr(&op->val, R_EAX, op->width);
+    op->load_width = op->width;
   }
-
-  print_Dop(op->str, OP_STR_SIZE, "%%%s", reg_name(R_EAX, op->width));
 }
 
 /* This helper function is use to decode register encoded in the opcode. */
@@ -61,9 +51,8 @@ static inline make_DopHelper(r) {
   op->reg = decinfo.opcode & 0x7;
   if (load_val) {
     rtl_lr(&op->val, op->reg, op->width);
+    op->load_width = op->width;
   }
-
-  print_Dop(op->str, OP_STR_SIZE, "%%%s", reg_name(op->reg, op->width));
 }
 
 /* I386 manual does not contain this abbreviation.
@@ -84,11 +73,13 @@ static inline void decode_op_rm(vaddr_t *pc, Operand *rm, bool load_rm_val, Oper
 static inline make_DopHelper(O) {
   op->type = OP_TYPE_MEM;
   rtl_li(&op->addr, instr_fetch(pc, 4));
+  decinfo.isa.base_reg = decinfo.isa.index_reg = -1;
+  decinfo.isa.disp = op->addr;
+  decinfo.isa.disp_size = 4;
   if (load_val) {
     rtl_lm(&op->val, &op->addr, op->width);
+    op->load_width = op->width;
   }
-
-  print_Dop(op->str, OP_STR_SIZE, "0x%x", op->addr);
 }
 
 /* Eb <- Gb
@@ -113,6 +104,32 @@ make_DHelper(mov_E2G) {
   decode_op_rm(pc, id_src, true, id_dest, false);
 }
 
+/* Cd <- Rd
+ * Rd <- Cd
+ * The reg field gives the control register, and the rm field the GPR,
+ * whatever the mod field is.
+ */
+static inline void decode_op_cr(vaddr_t *pc, Operand *cr, Operand *r, bool load_r_val) {
+  ModR_M m;
+  m.val = instr_fetch(pc, 1);
+  cr->type = OP_TYPE_REG;
+  cr->reg = m.reg;
+  r->type = OP_TYPE_REG;
+  r->reg = m.R_M;
+  if (load_r_val) {
+    rtl_lr(&r->val, r->reg, 4);
+    r->load_width = 4;
+  }
+}
+
+make_DHelper(mov_r2cr) {
+  decode_op_cr(pc, id_dest, id_src, true);
+}
+
+make_DHelper(mov_cr2r) {
+  decode_op_cr(pc, id_src, id_dest, false);
+}
+
 make_DHelper(lea_M2G) {
   decode_op_rm(pc, id_src, false, id_dest, false);
 }
@@ -210,17 +227,15 @@ make_DHelper(gp2_1_E) {
   id_src->type = OP_TYPE_IMM;
   id_src->imm = 1;
   rtl_li(&id_src->val, 1);
-
-  print_Dop(id_src->str, OP_STR_SIZE, "$1");
 }
 
 make_DHelper(gp2_cl2E) {
   decode_op_rm(pc, id_dest, true, NULL, false);
   id_src->type = OP_TYPE_REG;
   id_src->reg = R_CL;
+  id_src->width = 1;
   rtl_lr(&id_src->val, R_CL, 1);
-
-  print_Dop(id_src->str, OP_STR_SIZE, "%%cl");
+  id_src->load_width = 1;
 }
 
 make_DHelper(gp2_Ib2E) {
@@ -243,9 +258,9 @@ make_DHelper(cl_G2E) {
   decode_op_rm(pc, id_dest, true, id_src2, true);
   id_src->type = OP_TYPE_REG;
   id_src->reg = R_CL;
+  id_src->width = 1;
   rtl_lr(&id_src->val, R_CL, 1);
-
-  print_Dop(id_src->str, OP_STR_SIZE, "%%cl");
+  id_src->load_width = 1;
 }
 
 make_DHelper(O2a) {
@@ -278,8 +293,8 @@ make_DHelper(in_dx2a) {
   id_src->type = OP_TYPE_REG;
   id_src->reg = R_DX;
   rtl_lr(&id_src->val, R_DX, 2);
-
-  print_Dop(id_src->str, OP_STR_SIZE, "(%%dx)");
+  id_src->load_width = 2;
+  decinfo.isa.is_port_dx = true;
 
   decode_op_a(pc, id_dest, false);
 }
@@ -296,8 +311,8 @@ make_DHelper(out_a2dx) {
   id_dest->type = OP_TYPE_REG;
   id_dest->reg = R_DX;
   rtl_lr(&id_dest->val, R_DX, 2);
-
-  print_Dop(id_dest->str, OP_STR_SIZE, "(%%dx)");
+  id_dest->load_width = 2;
+  decinfo.isa.is_port_dx = true;
 }
 
 void operand_write(Operand *op, rtlreg_t* src) {
@@ -305,3 +320,30 @@ void operand_write(Operand *op, rtlreg_t* src) {
   else if (op->type == OP_TYPE_MEM) { rtl_sm(&op->addr, src, op->width); }
   else { assert(0); }
 }
+
+void isa_op_str(char *buf, size_t size, const Operand *op) {
+  switch (op->type) {
+    case OP_TYPE_REG:
+      if (decinfo.isa.is_port_dx && op->reg == R_DX) snprintf(buf, size, "(%%dx)");
+      else snprintf(buf, size, "%%%s", reg_name(op->reg, op->width));
+      break;
+    case OP_TYPE_IMM: snprintf(buf, size, "$0x%x", op->imm); break;
+    case OP_TYPE_MEM: {
+      // x86 has at most one memory operand, whose addressing mode is in `decinfo.isa'
+      struct ISADecodeInfo *d = &decinfo.isa;
+      char disp[16] = "", base[8] = "", index[16] = "";
+      if (d->base_reg == -1 && d->index_reg == -1) {
+        snprintf(buf, size, "0x%x", d->disp);
+        break;
+      }
+      if (d->disp_size != 0) {
+        sprintf(disp, "%s%#x", (d->disp < 0 ? "-" : ""), (d->disp < 0 ? -d->disp : d->disp));
+      }
+      if (d->base_reg != -1) sprintf(base, "%%%s", reg_name(d->base_reg, 4));
+      if (d->index_reg != -1) sprintf(index, ",%%%s,%d", reg_name(d->index_reg, 4), 1 << d->scale);
+      snprintf(buf, size, "%s(%s%s)", disp, base, index);
+      break;
+    }
+    default: snprintf(buf, size, "?");
+  }
+}
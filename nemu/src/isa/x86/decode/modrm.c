@@ -45,34 +45,11 @@ void load_addr(vaddr_t *pc, ModR_M *m, Operand *rm) {
   }
   rtl_mv(&rm->addr, &s0);
 
-#ifdef DEBUG
-  char disp_buf[16];
-  char base_buf[8];
-  char index_buf[8];
-
-  if (disp_size != 0) {
-    /* has disp */
-    sprintf(disp_buf, "%s%#x", (disp < 0 ? "-" : ""), (disp < 0 ? -disp : disp));
-  }
-  else { disp_buf[0] = '\0'; }
-
-  if (base_reg == -1) { base_buf[0] = '\0'; }
-  else { 
-    sprintf(base_buf, "%%%s", reg_name(base_reg, 4));
-  }
-
-  if (index_reg == -1) { index_buf[0] = '\0'; }
-  else { 
-    sprintf(index_buf, ",%%%s,%d", reg_name(index_reg, 4), 1 << scale);
-  }
-
-  if (base_reg == -1 && index_reg == -1) {
-    sprintf(rm->str, "%s", disp_buf);
-  }
-  else {
-    sprintf(rm->str, "%s(%s%s)", disp_buf, base_buf, index_buf);
-  }
-#endif
+  decinfo.isa.base_reg = base_reg;
+  decinfo.isa.index_reg = index_reg;
+  decinfo.isa.scale = scale;
+  decinfo.isa.disp = disp;
+  decinfo.isa.disp_size = disp_size;
 
   rm->type = OP_TYPE_MEM;
 }
@@ -86,11 +63,8 @@ void read_ModR_M(vaddr_t *pc, Operand *rm, bool load_rm_val, Operand *reg, bool
     reg->reg = m.reg;
     if (load_reg_val) {
       rtl_lr(&reg->val, reg->reg, reg->width);
+      reg->load_width = reg->width;
     }
-
-#ifdef DEBUG
-    snprintf(reg->str, OP_STR_SIZE, "%%%s", reg_name(reg->reg, reg->width));
-#endif
   }
 
   if (m.mod == 3) {
@@ -98,16 +72,14 @@ void read_ModR_M(vaddr_t *pc, Operand *rm, bool load_rm_val, Operand *reg, bool
     rm->reg = m.R_M;
     if (load_rm_val) {
       rtl_lr(&rm->val, m.R_M, rm->width);
+      rm->load_width = rm->width;
     }
-
-#ifdef DEBUG
-    sprintf(rm->str, "%%%s", reg_name(m.R_M, rm->width));
-#endif
   }
   else {
     load_addr(pc, &m, rm);
     if (load_rm_val) {
       rtl_lm(&rm->val, &rm->addr, rm->width);
+      rm->load_width = rm->width;
     }
   }
 }
@@ -1,8 +1,38 @@
 #include "nemu.h"
 #include "monitor/diff-test.h"
 
+// the flags which are modeled by NEMU
+#define EFLAGS_MASK ((1u << EFLAGS_CF) | (1u << EFLAGS_ZF) | (1u << EFLAGS_SF) | (1u << EFLAGS_OF))
+
+void eflags_materialize(void);
+
 bool isa_difftest_checkregs(CPU_state *ref_r, vaddr_t pc) {
-  return false;
+  eflags_materialize();
+
+  bool ok = true;
+  int i;
+  for (i = R_EAX; i <= R_EDI; i ++) {
+    if (ref_r->gpr[i]._32 != reg_l(i)) {
+      Log("%s is different at pc = 0x%08x, right = 0x%08x, wrong = 0x%08x",
+          reg_name(i, 4), pc, ref_r->gpr[i]._32, reg_l(i));
+      ok = false;
+    }
+  }
+  if (ref_r->pc != cpu.pc) {
+    Log("pc is different at pc = 0x%08x, right = 0x%08x, wrong = 0x%08x", pc, ref_r->pc, cpu.pc);
+    ok = false;
+  }
+  if ((ref_r->eflags & EFLAGS_MASK) != (cpu.eflags & EFLAGS_MASK)) {
+    Log("eflags is different at pc = 0x%08x, right = 0x%08x, wrong = 0x%08x",
+        pc, ref_r->eflags & EFLAGS_MASK, cpu.eflags & EFLAGS_MASK);
+    ok = false;
+  }
+  return ok;
+}
+
+/* Called before the registers are copied to or from the reference. */
+void isa_difftest_syncregs(void) {
+  eflags_materialize();
 }
 
 void isa_difftest_attach(void) {
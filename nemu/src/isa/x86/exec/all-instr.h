@@ -1,8 +1,34 @@
 #include "cpu/exec.h"
 
 make_EHelper(mov);
+make_EHelper(push);
+make_EHelper(pop);
+
+make_EHelper(jmp);
+make_EHelper(call);
+make_EHelper(ret);
+make_EHelper(loop);
+make_EHelper(jcc);
+make_EHelper(jmp_rm);
+
+make_EHelper(add);
+make_EHelper(adc);
+make_EHelper(sub);
+make_EHelper(sbb);
+make_EHelper(cmp);
+make_EHelper(inc);
+make_EHelper(dec);
+
+make_EHelper(and);
+make_EHelper(or);
+make_EHelper(xor);
+make_EHelper(test);
+make_EHelper(setcc);
 
 make_EHelper(operand_size);
 
 make_EHelper(inv);
+make_EHelper(invlpg);
+make_EHelper(mov_r2cr);
+make_EHelper(mov_cr2r);
 make_EHelper(nemu_trap);
@@ -1,31 +1,49 @@
 #include "cpu/exec.h"
 
 make_EHelper(add) {
-  TODO();
+  rtl_add(&s0, &id_dest->val, &id_src->val);
+  operand_write(id_dest, &s0);
+
+  // the flags are evaluated when they are used
+  rtl_set_cc(CC_OP_ADD, &s0, &id_dest->val, &id_src->val, id_dest->width);
 
   print_asm_template2(add);
 }
 
 make_EHelper(sub) {
-  TODO();
+  rtl_sub(&s0, &id_dest->val, &id_src->val);
+  operand_write(id_dest, &s0);
+
+  rtl_set_cc(CC_OP_SUB, &s0, &id_dest->val, &id_src->val, id_dest->width);
 
   print_asm_template2(sub);
 }
 
 make_EHelper(cmp) {
-  TODO();
+  rtl_sub(&s0, &id_dest->val, &id_src->val);
+
+  rtl_set_cc(CC_OP_SUB, &s0, &id_dest->val, &id_src->val, id_dest->width);
 
   print_asm_template2(cmp);
 }
 
 make_EHelper(inc) {
-  TODO();
+  rtl_addi(&s0, &id_dest->val, 1);
+  operand_write(id_dest, &s0);
+
+  // CF is not changed, so it is recorded as `src2'
+  rtl_get_CF(&s1);
+  rtl_set_cc(CC_OP_INC, &s0, &id_dest->val, &s1, id_dest->width);
 
   print_asm_template1(inc);
 }
 
 make_EHelper(dec) {
-  TODO();
+  rtl_subi(&s0, &id_dest->val, 1);
+  operand_write(id_dest, &s0);
+
+  rtl_get_CF(&s1);
+  rtl_set_cc(CC_OP_DEC, &s0, &id_dest->val, &s1, id_dest->width);
 
   print_asm_template1(dec);
 }
@@ -45,21 +63,8 @@ make_EHelper(adc) {
 
   operand_write(id_dest, &s1);
 
-  if (id_dest->width != 4) {
-    rtl_andi(&s1, &s1, 0xffffffffu >> ((4 - id_dest->width) * 8));
-  }
-
-  rtl_update_ZFSF(&s1, id_dest->width);
-
-  // update CF
-  rtl_is_add_carry(&s1, &s1, &s0);
-  rtl_is_add_carry(&s0, &s0, &id_dest->val);
-  rtl_or(&s0, &s0, &s1);
-  rtl_set_CF(&s0);
-
-  // update OF
-  rtl_is_add_overflow(&s0, &s1, &id_dest->val, &id_src->val, id_dest->width);
-  rtl_set_OF(&s0);
+  // the flags are evaluated when they are used
+  rtl_set_cc(CC_OP_ADC, &s1, &id_dest->val, &id_src->val, id_dest->width);
 
   print_asm_template2(adc);
 }
@@ -73,21 +78,8 @@ make_EHelper(sbb) {
 
   operand_write(id_dest, &s1);
 
-  if (id_dest->width != 4) {
-    rtl_andi(&s1, &s1, 0xffffffffu >> ((4 - id_dest->width) * 8));
-  }
-
-  rtl_update_ZFSF(&s1, id_dest->width);
-
-  // update CF
-  rtl_is_sub_carry(&s1, &s1, &s0);
-  rtl_is_sub_carry(&s0, &s0, &id_dest->val);
-  rtl_or(&s0, &s0, &s1);
-  rtl_set_CF(&s0);
-
-  // update OF
-  rtl_is_sub_overflow(&s0, &s1, &id_dest->val, &id_src->val, id_dest->width);
-  rtl_set_OF(&s0);
+  // the flags are evaluated when they are used
+  rtl_set_cc(CC_OP_SBB, &s1, &id_dest->val, &id_src->val, id_dest->width);
 
   print_asm_template2(sbb);
 }
@@ -1,5 +1,62 @@
 #include "rtl/rtl.h"
 
+/* Evaluate the flags of the last flag-producing operation into `eflags'. */
+void eflags_materialize(void) {
+  if (unlikely(jit_emitting)) {
+    // the operation is only known at run time
+    jit_instr_fail();
+    return;
+  }
+  if (cpu.cc.op == CC_OP_EFLAGS) return;
+
+  uint32_t mask = 0xffffffffu >> ((4 - cpu.cc.width) * 8);
+  uint32_t sign = 1u << (cpu.cc.width * 8 - 1);
+  uint32_t res = cpu.cc.res & mask;
+  uint32_t src1 = cpu.cc.src1 & mask;
+  uint32_t src2 = cpu.cc.src2 & mask;
+  uint32_t carry;
+  bool cf, of;
+
+  switch (cpu.cc.op) {
+    case CC_OP_ADD:
+      cf = res < src1;
+      of = ((src1 ^ res) & (src2 ^ res) & sign) != 0;
+      break;
+    case CC_OP_ADC:
+      // the carry-in is what is left after adding the two sources
+      carry = (res - src1 - src2) & mask;
+      cf = (carry ? res <= src1 : res < src1);
+      of = ((src1 ^ res) & (src2 ^ res) & sign) != 0;
+      break;
+    case CC_OP_SUB:
+      cf = src1 < src2;
+      of = ((src1 ^ src2) & (src1 ^ res) & sign) != 0;
+      break;
+    case CC_OP_SBB:
+      carry = (src1 - src2 - res) & mask;
+      cf = (carry ? src1 <= src2 : src1 < src2);
+      of = ((src1 ^ src2) & (src1 ^ res) & sign) != 0;
+      break;
+    case CC_OP_LOGIC:
+      cf = of = false;
+      break;
+    case CC_OP_INC:
+      cf = src2 & 0x1;
+      of = (res == sign);
+      break;
+    case CC_OP_DEC:
+      cf = src2 & 0x1;
+      of = (res == sign - 1);
+      break;
+    default: panic("unknown cc op = %d", cpu.cc.op);
+  }
+
+  cpu.eflags &= ~((1u << EFLAGS_CF) | (1u << EFLAGS_ZF) | (1u << EFLAGS_SF) | (1u << EFLAGS_OF));
+  cpu.eflags |= (cf << EFLAGS_CF) | ((res == 0) << EFLAGS_ZF) |
+    (((res & sign) != 0) << EFLAGS_SF) | (of << EFLAGS_OF);
+  cpu.cc.op = CC_OP_EFLAGS;
+}
+
 /* Condition Code */
 
 void rtl_setcc(rtlreg_t* dest, uint8_t subcode) {
@@ -11,19 +68,36 @@ void rtl_setcc(rtlreg_t* dest, uint8_t subcode) {
     CC_L, CC_NL, CC_LE, CC_NLE
   };
 
-  // TODO: Query EFLAGS to determine whether the condition code is satisfied.
+  if (unlikely(jit_emitting)) {
+    jit_instr_fail();
+    return;
+  }
+
   // dest <- ( cc is satisfied ? 1 : 0)
-  switch (subcode & 0xe) {
-    case CC_O:
-    case CC_B:
-    case CC_E:
-    case CC_BE:
-    case CC_S:
-    case CC_L:
-    case CC_LE:
-      TODO();
-    default: panic("should not reach here");
-    case CC_P: panic("n86 does not have PF");
+  static const uint32_t sub_relop[16] = {
+    [CC_B] = RELOP_LTU, [CC_E] = RELOP_EQ, [CC_BE] = RELOP_LEU,
+    [CC_L] = RELOP_LT, [CC_LE] = RELOP_LE,
+  };
+  uint32_t relop = sub_relop[subcode & 0xe];
+  if (cpu.cc.op == CC_OP_SUB && cpu.cc.width == 4 && relop != RELOP_FALSE) {
+    // compare the operands of the last sub/cmp without evaluating the flags
+    rtl_setrelop(relop, dest, &cpu.cc.src1, &cpu.cc.src2);
+  }
+  else {
+    switch (subcode & 0xe) {
+      case CC_O: rtl_get_OF(dest); break;
+      case CC_B: rtl_get_CF(dest); break;
+      case CC_E: rtl_get_ZF(dest); break;
+      case CC_BE: rtl_get_CF(dest); rtl_get_ZF(&t0); rtl_or(dest, dest, &t0); break;
+      case CC_S: rtl_get_SF(dest); break;
+      case CC_L: rtl_get_SF(dest); rtl_get_OF(&t0); rtl_xor(dest, dest, &t0); break;
+      case CC_LE:
+        rtl_get_SF(dest); rtl_get_OF(&t0); rtl_xor(dest, dest, &t0);
+        rtl_get_ZF(&t0); rtl_or(dest, dest, &t0);
+        break;
+      default: panic("should not reach here");
+      case CC_P: panic("n86 does not have PF");
+    }
   }
 
   if (invert) {
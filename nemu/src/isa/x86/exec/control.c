@@ -21,18 +21,21 @@ make_EHelper(jcc) {
 make_EHelper(jmp_rm) {
   rtl_jr(&id_dest->val);
 
-  print_asm("jmp *%s", id_dest->str);
+  print_asm("jmp *%s", op_str(id_dest));
 }
 
 make_EHelper(call) {
   // the target address is calculated at the decode stage
-  TODO();
+  rtl_li(&s0, decinfo.seq_pc);
+  rtl_push(&s0);
+  rtl_j(decinfo.jmp_pc);
 
   print_asm("call %x", decinfo.jmp_pc);
 }
 
 make_EHelper(ret) {
-  TODO();
+  rtl_pop(&s0);
+  rtl_jr(&s0);
 
   print_asm("ret");
 }
@@ -40,11 +43,20 @@ make_EHelper(ret) {
 make_EHelper(ret_imm) {
   TODO();
 
-  print_asm("ret %s", id_dest->str);
+  print_asm("ret %s", op_str(id_dest));
 }
 
 make_EHelper(call_rm) {
   TODO();
 
-  print_asm("call *%s", id_dest->str);
+  print_asm("call *%s", op_str(id_dest));
+}
+
+make_EHelper(loop) {
+  // the target address is calculated at the decode stage
+  rtl_subi(&cpu.ecx, &cpu.ecx, 1);
+  rtl_li(&s0, 0);
+  rtl_jrelop(RELOP_NE, &cpu.ecx, &s0, decinfo.jmp_pc);
+
+  print_asm("loop %x", decinfo.jmp_pc);
 }
@@ -2,25 +2,37 @@
 #include "cc.h"
 
 make_EHelper(test) {
-  TODO();
+  rtl_and(&s0, &id_dest->val, &id_src->val);
+
+  // the flags are evaluated when they are used
+  rtl_set_cc(CC_OP_LOGIC, &s0, NULL, NULL, id_dest->width);
 
   print_asm_template2(test);
 }
 
 make_EHelper(and) {
-  TODO();
+  rtl_and(&s0, &id_dest->val, &id_src->val);
+  operand_write(id_dest, &s0);
+
+  rtl_set_cc(CC_OP_LOGIC, &s0, NULL, NULL, id_dest->width);
 
   print_asm_template2(and);
 }
 
 make_EHelper(xor) {
-  TODO();
+  rtl_xor(&s0, &id_dest->val, &id_src->val);
+  operand_write(id_dest, &s0);
+
+  rtl_set_cc(CC_OP_LOGIC, &s0, NULL, NULL, id_dest->width);
 
   print_asm_template2(xor);
 }
 
 make_EHelper(or) {
-  TODO();
+  rtl_or(&s0, &id_dest->val, &id_src->val);
+  operand_write(id_dest, &s0);
+
+  rtl_set_cc(CC_OP_LOGIC, &s0, NULL, NULL, id_dest->width);
 
   print_asm_template2(or);
 }
@@ -52,7 +64,7 @@ make_EHelper(setcc) {
   rtl_setcc(&s0, cc);
   operand_write(id_dest, &s0);
 
-  print_asm("set%s %s", get_cc_name(cc), id_dest->str);
+  print_asm("set%s %s", get_cc_name(cc), op_str(id_dest));
 }
 
 make_EHelper(not) {
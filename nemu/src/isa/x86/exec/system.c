@@ -1,29 +1,78 @@
 #include "cpu/exec.h"
+#include "isa/mmu.h"
 
 make_EHelper(lidt) {
+  if (jit_emitting) {
+    // the IDTR is written by C code
+    jit_instr_fail();
+    return;
+  }
+
   TODO();
 
   print_asm_template1(lidt);
 }
 
 make_EHelper(mov_r2cr) {
-  TODO();
+  if (jit_emitting) {
+    // the TLB is flushed by C code
+    jit_instr_fail();
+    return;
+  }
+
+  switch (id_dest->reg) {
+    case 0: cpu.cr0 = id_src->val; break;
+    case 3: cpu.cr3 = id_src->val; break;
+    default: panic("unsupported control register cr%d", id_dest->reg);
+  }
+  // the address space is changed
+  tlb_flush();
+  decode_cache_flush();
 
   print_asm("movl %%%s,%%cr%d", reg_name(id_src->reg, 4), id_dest->reg);
 }
 
 make_EHelper(mov_cr2r) {
-  TODO();
+  if (jit_emitting) {
+    // the reference is told to skip by C code
+    jit_instr_fail();
+    return;
+  }
+
+  switch (id_src->reg) {
+    case 0: rtl_sr(id_dest->reg, &cpu.cr0, 4); break;
+    case 3: rtl_sr(id_dest->reg, &cpu.cr3, 4); break;
+    default: panic("unsupported control register cr%d", id_src->reg);
+  }
 
   print_asm("movl %%cr%d,%%%s", id_src->reg, reg_name(id_dest->reg, 4));
 
   difftest_skip_ref();
 }
 
+make_EHelper(invlpg) {
+  if (jit_emitting) {
+    jit_instr_fail();
+    return;
+  }
+
+  tlb_flush_page(id_dest->addr);
+  // cached decodings are indexed by virtual address
+  decode_cache_flush();
+
+  print_asm("invlpg %s", op_str(id_dest));
+}
+
 make_EHelper(int) {
+  if (jit_emitting) {
+    // the reference is told to skip by C code
+    jit_instr_fail();
+    return;
+  }
+
   TODO();
 
-  print_asm("int %s", id_dest->str);
+  print_asm("int %s", op_str(id_dest));
 
   difftest_skip_dut(1, 2);
 }
@@ -42,12 +91,24 @@ void pio_write_w(ioaddr_t, uint32_t);
 void pio_write_b(ioaddr_t, uint32_t);
 
 make_EHelper(in) {
+  if (jit_emitting) {
+    // devices are accessed by C code
+    jit_instr_fail();
+    return;
+  }
+
   TODO();
 
   print_asm_template2(in);
 }
 
 make_EHelper(out) {
+  if (jit_emitting) {
+    // devices are accessed by C code
+    jit_instr_fail();
+    return;
+  }
+
   TODO();
 
   print_asm_template2(out);
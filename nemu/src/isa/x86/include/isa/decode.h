@@ -7,6 +7,13 @@
 struct ISADecodeInfo {
   bool is_operand_size_16;
   uint8_t ext_opcode;
+  bool is_port_dx;  // %dx is the port of in/out, printed as `(%dx)'
+
+  /* addressing mode of the memory operand, used to
+   * recompute its address when replaying a cached decoding */
+  int8_t base_reg, index_reg;
+  uint8_t scale, disp_size;
+  int32_t disp;
 };
 
 #define suffix_char(width) ((width) == 4 ? 'l' : ((width) == 1 ? 'b' : ((width) == 2 ? 'w' : '?')))
@@ -36,6 +43,24 @@ typedef union {
 void load_addr(vaddr_t *, ModR_M *, Operand *);
 void read_ModR_M(vaddr_t *, Operand *, bool, Operand *, bool);
 
+/* decode cache */
+#define DC_LINE_SHIFT 6
+#define DC_NR_LINE (1 << 20)
+#define dc_line(addr) (((addr) >> DC_LINE_SHIFT) % DC_NR_LINE)
+
+extern uint8_t dc_code_line[];
+void decode_cache_flush(void);
+void decode_cache_invalidate(vaddr_t addr, int len);
+
+/* Cached decodings are dropped once the memory holding them is written.
+ * Lines of memory with cached code are marked, hashed by their address,
+ * so that most other stores skip the lookup. */
+static inline void decode_cache_check_write(vaddr_t addr, int len) {
+  if (dc_code_line[dc_line(addr)] | dc_code_line[dc_line(addr + len - 1)]) {
+    decode_cache_invalidate(addr, len);
+  }
+}
+
 make_DHelper(I2E);
 make_DHelper(I2a);
 make_DHelper(I2r);
@@ -58,6 +83,8 @@ make_DHelper(mov_I2E);
 make_DHelper(mov_G2E);
 make_DHelper(mov_E2G);
 make_DHelper(lea_M2G);
+make_DHelper(mov_r2cr);
+make_DHelper(mov_cr2r);
 
 make_DHelper(gp2_1_E);
 make_DHelper(gp2_cl2E);
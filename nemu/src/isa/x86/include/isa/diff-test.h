@@ -1,6 +1,6 @@
 #ifndef __X86_DIFF_TEST_H__
 #define __X86_DIFF_TEST_H__
 
-#define DIFFTEST_REG_SIZE (sizeof(uint32_t) * 9) // GRPs + EIP
+#define DIFFTEST_REG_SIZE (sizeof(uint32_t) * 10) // GRPs + EIP + EFLAGS
 
 #endif
@@ -68,6 +68,11 @@ typedef union PageTableEntry {
 
 typedef PTE (*PT) [NR_PTE];
 
+void tlb_flush(void);
+void tlb_flush_page(vaddr_t addr);
+void vaddr_read_block(vaddr_t addr, void *buf, size_t len);
+void vaddr_write_block(vaddr_t addr, const void *buf, size_t len);
+
 typedef union GateDescriptor {
   struct {
     uint32_t offset_15_0      : 16;
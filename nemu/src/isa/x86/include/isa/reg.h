@@ -34,9 +34,29 @@ typedef struct {
   */
 
   vaddr_t pc;
+  rtlreg_t eflags;
+
+  /* EFLAGS are evaluated lazily. The last flag-producing operation is
+   * recorded in `cc', and CF, ZF, SF and OF in `eflags' are up to date
+   * only when `cc.op' is CC_OP_EFLAGS. See eflags_materialize(). */
+  struct {
+    rtlreg_t op, width;
+    rtlreg_t res, src1, src2;
+  } cc;
+
+  rtlreg_t cr0, cr3;
 
 } CPU_state;
 
+enum { EFLAGS_CF = 0, EFLAGS_ZF = 6, EFLAGS_SF = 7, EFLAGS_IF = 9, EFLAGS_OF = 11 };
+
+enum {
+  CC_OP_EFLAGS,  // flags are in `eflags'
+  CC_OP_ADD, CC_OP_ADC, CC_OP_SUB, CC_OP_SBB,
+  CC_OP_LOGIC,   // CF and OF are cleared
+  CC_OP_INC, CC_OP_DEC,  // `src2' keeps the CF before
+};
+
 static inline int check_reg_index(int index) {
   assert(index >= 0 && index < 8);
   return index;
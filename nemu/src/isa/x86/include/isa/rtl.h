@@ -26,13 +26,17 @@ static inline void rtl_sr(int r, const rtlreg_t* src1, int width) {
 static inline void rtl_push(const rtlreg_t* src1) {
   // esp <- esp - 4
   // M[esp] <- src1
-  TODO();
+  rtl_subi(&t0, &cpu.esp, 4);
+  rtl_sm(&t0, src1, 4);
+  rtl_mv(&cpu.esp, &t0);
 }
 
 static inline void rtl_pop(rtlreg_t* dest) {
   // dest <- M[esp]
   // esp <- esp + 4
-  TODO();
+  rtl_lm(&t0, &cpu.esp, 4);
+  rtl_addi(&cpu.esp, &cpu.esp, 4);
+  rtl_mv(dest, &t0);
 }
 
 static inline void rtl_is_sub_overflow(rtlreg_t* dest,
@@ -59,12 +63,31 @@ static inline void rtl_is_add_carry(rtlreg_t* dest,
   TODO();
 }
 
+void eflags_materialize(void);
+
+/* Record a flag-producing operation, whose flags are evaluated later
+ * when they are used. `src1' and `src2' are not used by CC_OP_LOGIC. */
+static inline void rtl_set_cc(uint32_t op, const rtlreg_t* res,
+    const rtlreg_t* src1, const rtlreg_t* src2, int width) {
+  rtl_li(&cpu.cc.op, op);
+  rtl_li(&cpu.cc.width, width);
+  rtl_mv(&cpu.cc.res, res);
+  if (src1 != NULL) rtl_mv(&cpu.cc.src1, src1);
+  if (src2 != NULL) rtl_mv(&cpu.cc.src2, src2);
+}
+
 #define make_rtl_setget_eflags(f) \
   static inline void concat(rtl_set_, f) (const rtlreg_t* src) { \
-    TODO(); \
+    eflags_materialize(); \
+    rtl_andi(&t0, src, 0x1); \
+    rtl_shli(&t0, &t0, concat(EFLAGS_, f)); \
+    rtl_andi(&cpu.eflags, &cpu.eflags, ~(1u << concat(EFLAGS_, f))); \
+    rtl_or(&cpu.eflags, &cpu.eflags, &t0); \
   } \
   static inline void concat(rtl_get_, f) (rtlreg_t* dest) { \
-    TODO(); \
+    eflags_materialize(); \
+    rtl_shri(dest, &cpu.eflags, concat(EFLAGS_, f)); \
+    rtl_andi(dest, dest, 0x1); \
   }
 
 make_rtl_setget_eflags(CF)
@@ -74,12 +97,15 @@ make_rtl_setget_eflags(SF)
 
 static inline void rtl_update_ZF(const rtlreg_t* result, int width) {
   // eflags.ZF <- is_zero(result[width * 8 - 1 .. 0])
-  TODO();
+  rtl_shli(&t1, result, 32 - width * 8);
+  rtl_setrelopi(RELOP_EQ, &t1, &t1, 0);
+  rtl_set_ZF(&t1);
 }
 
 static inline void rtl_update_SF(const rtlreg_t* result, int width) {
   // eflags.SF <- is_sign(result[width * 8 - 1 .. 0])
-  TODO();
+  rtl_shri(&t1, result, width * 8 - 1);
+  rtl_set_SF(&t1);
 }
 
 static inline void rtl_update_ZFSF(const rtlreg_t* result, int width) {
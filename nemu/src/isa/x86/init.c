@@ -1,4 +1,5 @@
 #include "nemu.h"
+#include "isa/mmu.h"
 
 const uint8_t isa_default_img []  = {
   0xb8, 0x34, 0x12, 0x00, 0x00,        // 100000:  movl  $0x1234,%eax
@@ -16,6 +17,12 @@ const long isa_default_img_size = sizeof(isa_default_img);
 static void restart() {
   /* Set the initial program counter. */
   cpu.pc = PC_START;
+
+  cpu.eflags = 0x2;
+  cpu.cc.op = CC_OP_EFLAGS;
+
+  cpu.cr0 = 0x60000011;
+  tlb_flush();
 }
 
 void init_isa(void) {
@@ -1,9 +1,184 @@
 #include "nemu.h"
+#include "cpu/decode.h"
+#include "isa/mmu.h"
+#include "monitor/itrace.h"
+
+/* Software TLB. Each access type has a direct-mapped TLB which maps a
+ * virtual page to its host page in pmem, so that a hit takes a tag compare
+ * and a host access. Pages outside pmem (MMIO) are never entered. The TLB
+ * is also used when paging is disabled, with the identity mapping.
+ */
+
+#define TLB_NR_ENTRY 256
+#define TLB_INVALID 0x1  // never equal to a page-aligned tag
+
+enum { TLB_READ, TLB_WRITE, NR_TLB };
+
+typedef struct {
+  vaddr_t tag;
+  uintptr_t addend;  // host address = addend + vaddr
+} TLBEntry;
+
+static TLBEntry tlb[NR_TLB][TLB_NR_ENTRY];
+
+uint64_t nr_vaddr_write = 0;
+
+static inline TLBEntry* tlb_entry(int type, vaddr_t addr) {
+  return &tlb[type][(addr / PAGE_SIZE) % TLB_NR_ENTRY];
+}
+
+static inline bool tlb_hit(TLBEntry *e, vaddr_t addr, int len) {
+  return e->tag == (addr & ~PAGE_MASK) && (addr & PAGE_MASK) <= PAGE_SIZE - len;
+}
+
+void tlb_flush(void) {
+  int i, j;
+  for (i = 0; i < NR_TLB; i ++) {
+    for (j = 0; j < TLB_NR_ENTRY; j ++) {
+      tlb[i][j].tag = TLB_INVALID;
+    }
+  }
+}
+
+void tlb_flush_page(vaddr_t addr) {
+  int i;
+  for (i = 0; i < NR_TLB; i ++) {
+    TLBEntry *e = tlb_entry(i, addr);
+    if (e->tag == (addr & ~PAGE_MASK)) e->tag = TLB_INVALID;
+  }
+}
+
+/* Called after memory or the registers are changed from outside, by
+ * difftest or a snapshot. */
+void isa_memory_changed(void) {
+  tlb_flush();
+  decode_cache_flush();
+}
+
+bool isa_paging_enabled(void) {
+  CR0 cr0 = { .val = cpu.cr0 };
+  return cr0.paging;
+}
+
+static paddr_t page_translate(vaddr_t addr, bool is_write) {
+  CR0 cr0 = { .val = cpu.cr0 };
+  if (!cr0.paging) return addr;
+
+  CR3 cr3 = { .val = cpu.cr3 };
+  paddr_t pde_addr = (cr3.page_directory_base << 12) + (addr >> 22) * sizeof(PDE);
+  PDE pde = { .val = paddr_read(pde_addr, 4) };
+  Assert(pde.present, "invalid PDE = 0x%08x at vaddr = 0x%08x, pc = 0x%08x", pde.val, addr, cpu.pc);
+  if (!pde.accessed) {
+    pde.accessed = 1;
+    paddr_write(pde_addr, pde.val, 4);
+  }
+
+  paddr_t pte_addr = (pde.page_frame << 12) + ((addr >> 12) & (NR_PTE - 1)) * sizeof(PTE);
+  PTE pte = { .val = paddr_read(pte_addr, 4) };
+  Assert(pte.present, "invalid PTE = 0x%08x at vaddr = 0x%08x, pc = 0x%08x", pte.val, addr, cpu.pc);
+  if (!pte.accessed || (is_write && !pte.dirty)) {
+    pte.accessed = 1;
+    pte.dirty |= is_write;
+    paddr_write(pte_addr, pte.val, 4);
+  }
+
+  return (pte.page_frame << 12) | (addr & PAGE_MASK);
+}
+
+/* Translate `addr', which does not cross a page, and enter it into the
+ * TLB if it is in pmem. Return the host address, or NULL for MMIO with
+ * the physical address in `*paddr'. Stores to a watched page are left to
+ * paddr_write(). */
+static void* tlb_fill(int type, vaddr_t addr, paddr_t *paddr) {
+  *paddr = page_translate(addr, type == TLB_WRITE);
+  uint8_t *host = (type == TLB_WRITE ? paddr_host(*paddr) : pmem_host(*paddr));
+  if (host != NULL) {
+    TLBEntry *e = tlb_entry(type, addr);
+    e->tag = addr & ~PAGE_MASK;
+    e->addend = (uintptr_t)host - addr;
+  }
+  return host;
+}
+
+static uint32_t vaddr_read_slow(vaddr_t addr, int len) {
+  if ((addr & PAGE_MASK) > PAGE_SIZE - len) {
+    // the access crosses a page
+    uint32_t data = 0;
+    int i;
+    for (i = 0; i < len; i ++) {
+      data |= vaddr_read_slow(addr + i, 1) << (i * 8);
+    }
+    return data;
+  }
+
+  paddr_t paddr;
+  uint8_t *host = tlb_fill(TLB_READ, addr, &paddr);
+  if (host == NULL) return paddr_read(paddr, len);
+  return *(uint32_t *)host & (~0u >> ((4 - len) << 3));
+}
+
+static void vaddr_write_slow(vaddr_t addr, uint32_t data, int len) {
+  if ((addr & PAGE_MASK) > PAGE_SIZE - len) {
+    int i;
+    for (i = 0; i < len; i ++) {
+      vaddr_write_slow(addr + i, data >> (i * 8), 1);
+    }
+    return;
+  }
+
+  paddr_t paddr;
+  uint8_t *host = tlb_fill(TLB_WRITE, addr, &paddr);
+  if (host == NULL) paddr_write(paddr, data, len);
+  else {
+    difftest_log_store(host, len);
+    memcpy(host, &data, len);
+  }
+}
 
 uint32_t isa_vaddr_read(vaddr_t addr, int len) {
-  return paddr_read(addr, len);
+  TLBEntry *e = tlb_entry(TLB_READ, addr);
+  if (likely(tlb_hit(e, addr, len))) {
+    return *(uint32_t *)(e->addend + addr) & (~0u >> ((4 - len) << 3));
+  }
+  return vaddr_read_slow(addr, len);
 }
 
 void isa_vaddr_write(vaddr_t addr, uint32_t data, int len) {
-  paddr_write(addr, data, len);
+  nr_vaddr_write ++;
+  decode_cache_check_write(addr, len);
+
+  TLBEntry *e = tlb_entry(TLB_WRITE, addr);
+  if (likely(tlb_hit(e, addr, len))) {
+    difftest_log_store((void *)(e->addend + addr), len);
+    memcpy((void *)(e->addend + addr), &data, len);
+    return;
+  }
+  vaddr_write_slow(addr, data, len);
+}
+
+/* Block accesses for string operations, translated page by page. */
+void vaddr_read_block(vaddr_t addr, void *buf, size_t len) {
+#ifdef DEBUG
+  itrace_mem(addr, false);
+#endif
+  while (len > 0) {
+    size_t n = PAGE_SIZE - (addr & PAGE_MASK);
+    if (n > len) n = len;
+    paddr_read_block(page_translate(addr, false), buf, n);
+    addr += n; buf += n; len -= n;
+  }
+}
+
+void vaddr_write_block(vaddr_t addr, const void *buf, size_t len) {
+  nr_vaddr_write ++;
+#ifdef DEBUG
+  itrace_mem(addr, true);
+#endif
+  while (len > 0) {
+    size_t n = PAGE_SIZE - (addr & PAGE_MASK);
+    if (n > len) n = len;
+    decode_cache_check_write(addr, n);
+    paddr_write_block(page_translate(addr, true), buf, n);
+    addr += n; buf += n; len -= n;
+  }
 }
@@ -67,6 +67,29 @@ void isa_reg_display(){
   printf("dh        0x%-20x      %-20d \n", cpu.gpr[3]._8[1], cpu.gpr[3]._8[1]);
 }
 
+/* Return the address of the register named `s' (without `$'), and its
+ * width in bytes. */
+const void* isa_reg_str2addr(const char *s, int *width) {
+  int i;
+  for (i = R_EAX; i <= R_EDI; i ++) {
+    if (strcmp(s, regsl[i]) == 0) { *width = 4; return &reg_l(i); }
+    if (strcmp(s, regsw[i]) == 0) { *width = 2; return &reg_w(i); }
+    if (strcmp(s, regsb[i]) == 0) { *width = 1; return &reg_b(i); }
+  }
+  if (strcmp(s, "eip") == 0 || strcmp(s, "pc") == 0) { *width = 4; return &cpu.pc; }
+  return NULL;
+}
+
 uint32_t isa_reg_str2val(const char *s, bool *success) {
-  return 0;
+  int width;
+  const void *p = isa_reg_str2addr(s, &width);
+  if (p == NULL) {
+    *success = false;
+    return 0;
+  }
+  switch (width) {
+    case 1: return *(uint8_t *)p;
+    case 2: return *(uint16_t *)p;
+    default: return *(uint32_t *)p;
+  }
 }
@@ -1,41 +1,172 @@
 #include "nemu.h"
 #include "device/map.h"
+#include <sys/mman.h>
 
+/* pmem is in bss, which the host maps lazily, so only the pages touched
+ * by the guest take host memory. */
 uint8_t pmem[PMEM_SIZE] PG_ALIGN = {};
 
-static IOMap pmem_map = {
-  .name = "pmem",
-  .space = pmem,
-  .callback = NULL
-};
+uint8_t *pmap_host[PMAP_NR_PAGE] = {};
+
+static paddr_t pmem_base = 0;
+// the number of memory watchpoints on each page of pmem
+static uint16_t pmem_nr_watch[PMEM_SIZE / PAGE_SIZE] = {};
+
+uint64_t nr_mmio_read = 0;
+paddr_t last_mmio_read = 0;
 
 void register_pmem(paddr_t base) {
-  pmem_map.low = base;
-  pmem_map.high = base + PMEM_SIZE - 1;
+  pmem_base = base;
+  uint32_t i;
+  for (i = 0; i < PMEM_SIZE / PAGE_SIZE; i ++) {
+    pmap_host[base / PAGE_SIZE + i] = pmem + i * PAGE_SIZE;
+  }
+
+  Log("Add '%s' at [0x%08x, 0x%08x]", "pmem", base, base + PMEM_SIZE - 1);
+}
 
-  Log("Add '%s' at [0x%08x, 0x%08x]", pmem_map.name, pmem_map.low, pmem_map.high);
+/* Map `len' bytes of `fd' from `offset' over the page-aligned host memory
+ * at `host', copy-on-write, so that the pages are read from the file when
+ * first touched, and shared with the page cache until they are written.
+ * The file must not be truncated while it is mapped. Return false if it
+ * can not be mapped, and the memory is unchanged then. */
+bool host_map_file(void *host, size_t len, int fd, off_t offset) {
+  if (((uintptr_t)host & PAGE_MASK) != 0 || (offset & PAGE_MASK) != 0) return false;
+  return mmap(host, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, offset) != MAP_FAILED;
+}
+
+/* Clear the page-aligned host memory at `host', and give its pages back
+ * to the host. */
+void host_map_zero(void *host, size_t len) {
+  assert(((uintptr_t)host & PAGE_MASK) == 0);
+  void *p = mmap(host, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) memset(host, 0, len);
 }
 
 IOMap* fetch_mmio_map(paddr_t addr);
+void isa_memory_changed(void);
+void wp_store(paddr_t addr, int len);
+
+/* Return the host address of `addr' if it is in pmem, even if its page
+ * is watched. */
+void* pmem_host(paddr_t addr) {
+  paddr_t offset = addr - pmem_base;
+  return (offset < PMEM_SIZE ? pmem + offset : NULL);
+}
+
+/* A watched page is removed from `pmap_host', so that accesses to it take
+ * the slow path below, where stores are reported to the watchpoints. The
+ * TLB is flushed, so that it does not keep the page for stores either. */
+static void pmem_watch_pages(paddr_t addr, int len, int delta) {
+  paddr_t p;
+  for (p = addr / PAGE_SIZE; p <= (addr + len - 1) / PAGE_SIZE; p ++) {
+    uint8_t *host = pmem_host(p * PAGE_SIZE);
+    if (host == NULL) continue;
+    uint16_t *nr = &pmem_nr_watch[host_to_guest(host) / PAGE_SIZE];
+    *nr += delta;
+    pmap_host[p] = (*nr == 0 ? host : NULL);
+  }
+  isa_memory_changed();
+}
+
+void pmem_watch(paddr_t addr, int len) {
+  pmem_watch_pages(addr, len, 1);
+}
+
+void pmem_unwatch(paddr_t addr, int len) {
+  pmem_watch_pages(addr, len, -1);
+}
+
+static inline IOMap* pmap_fetch_mmio(paddr_t addr) {
+  IOMap *map = fetch_mmio_map(addr);
+  // the reference does not have the devices
+  if (map != NULL) difftest_skip_ref();
+  return map;
+}
+
+/* Return the host address of `addr', or NULL if it is not in pmem or its
+ * page is watched. */
+void* paddr_host(paddr_t addr) {
+  uint8_t *host = pmap_host[addr / PAGE_SIZE];
+  return (host != NULL ? host + (addr & PAGE_MASK) : NULL);
+}
 
 /* Memory accessing interfaces */
 
-uint32_t paddr_read(paddr_t addr, int len) {
-  if (map_inside(&pmem_map, addr)) {
-    uint32_t offset = addr - pmem_map.low;
-    return *(uint32_t *)(pmem + offset) & (~0u >> ((4 - len) << 3));
+uint32_t paddr_read_mmio(paddr_t addr, int len) {
+  uint8_t *host = pmem_host(addr);
+  if (host != NULL) return *(uint32_t *)host & (~0u >> ((4 - len) << 3));
+
+  nr_mmio_read ++;
+  last_mmio_read = addr;
+  return map_read(addr, len, pmap_fetch_mmio(addr));
+}
+
+void paddr_write_mmio(paddr_t addr, uint32_t data, int len) {
+  uint8_t *host = pmem_host(addr);
+  if (host != NULL) {
+    // a watched page
+    difftest_log_store(host, len);
+    memcpy(host, &data, len);
+    wp_store(addr, len);
+    return;
   }
-  else {
-    return map_read(addr, len, fetch_mmio_map(addr));
+
+  map_write(addr, data, len, pmap_fetch_mmio(addr));
+}
+
+uint32_t paddr_read(paddr_t addr, int len) {
+  switch (len) {
+    case 4: return paddr_read32(addr);
+    case 2: return paddr_read16(addr);
+    case 1: return paddr_read8(addr);
+    default: return paddr_read_mmio(addr, len);
   }
 }
 
 void paddr_write(paddr_t addr, uint32_t data, int len) {
-  if (map_inside(&pmem_map, addr)) {
-    uint32_t offset = addr - pmem_map.low;
-    memcpy(pmem + offset, &data, len);
+  switch (len) {
+    case 4: paddr_write32(addr, data); return;
+    case 2: paddr_write16(addr, data); return;
+    case 1: paddr_write8(addr, data); return;
+    default: paddr_write_mmio(addr, data, len);
+  }
+}
+
+/* Copy `len' bytes between physical memory and `buf'. Pages in pmem are
+ * copied directly, and MMIO is accessed by blocks inside each map. */
+void paddr_read_block(paddr_t addr, void *buf, size_t len) {
+  while (len > 0) {
+    size_t n = PAGE_SIZE - (addr & PAGE_MASK);
+    uint8_t *host = pmem_host(addr);
+    if (host != NULL) {
+      if (n > len) n = len;
+      memcpy(buf, host, n);
+    }
+    else {
+      IOMap *map = pmap_fetch_mmio(addr);
+      n = (map != NULL && map->high - addr + 1 < len ? map->high - addr + 1 : len);
+      map_read_block(addr, buf, n, map);
+    }
+    addr += n; buf += n; len -= n;
   }
-  else {
-    return map_write(addr, data, len, fetch_mmio_map(addr));
+}
+
+void paddr_write_block(paddr_t addr, const void *buf, size_t len) {
+  while (len > 0) {
+    size_t n = PAGE_SIZE - (addr & PAGE_MASK);
+    uint8_t *host = pmem_host(addr);
+    if (host != NULL) {
+      if (n > len) n = len;
+      difftest_log_store(host, n);
+      memcpy(host, buf, n);
+      if (pmap_host[addr / PAGE_SIZE] == NULL) wp_store(addr, n);
+    }
+    else {
+      IOMap *map = pmap_fetch_mmio(addr);
+      n = (map != NULL && map->high - addr + 1 < len ? map->high - addr + 1 : len);
+      map_write_block(addr, buf, n, map);
+    }
+    addr += n; buf += n; len -= n;
   }
 }
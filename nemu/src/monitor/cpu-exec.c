@@ -1,6 +1,8 @@
 #include "nemu.h"
 #include "monitor/monitor.h"
 #include "monitor/watchpoint.h"
+#include "device/event.h"
+#include "monitor/itrace.h"
 
 /* The assembly code of instructions executed is only output to the screen
  * when the number of instructions executed is less than this value.
@@ -9,8 +11,11 @@
  */
 #define MAX_INSTR_TO_PRINT 10
 
-/* restrict the size of log file */
-#define LOG_MAX (1024 * 1024)
+/* When instructions are executed by translated blocks, they are run in
+ * slices of at most this many instructions, which also end at the next
+ * device event.
+ */
+#define NR_INSTR_PER_SLICE 65536
 
 NEMUState nemu_state = {.state = NEMU_STOP};
 
@@ -19,44 +24,46 @@ void interpret_rtl_exit(int state, vaddr_t halt_pc, uint32_t halt_ret) {
 }
 
 vaddr_t exec_once(void);
+uint64_t isa_exec_blocks(uint64_t n);
+bool jit_enabled(void);
 void difftest_step(vaddr_t ori_pc, vaddr_t next_pc);
+void difftest_flush(void);
 void asm_print(vaddr_t ori_pc, int instr_len, bool print_flag);
+extern bool print_asm_on;
 
-static uint64_t g_nr_guest_instr = 0;
+uint64_t g_nr_guest_instr = 0;
+uint64_t g_nr_slice_instr = 0;
 
 void monitor_statistic(void) {
   Log("total guest instructions = %ld", g_nr_guest_instr);
 }
 
-/* Simulate how the CPU works. */
-void cpu_exec(uint64_t n) {
-  switch (nemu_state.state) {
-    case NEMU_END: case NEMU_ABORT:
-      printf("Program execution has ended. To restart the program, exit NEMU and run again.\n");
-      return;
-    default: nemu_state.state = NEMU_RUNNING;
-  }
-
+#if defined(DEBUG) || defined(DIFF_TEST)
+static void exec_by_instr(uint64_t n) {
   for (; n > 0; n --) {
     __attribute__((unused)) vaddr_t ori_pc = cpu.pc;
+    if (bp_hit(ori_pc)) break;
+
+#ifdef DEBUG
+    itrace_begin(ori_pc);
+    print_asm_on = (n < MAX_INSTR_TO_PRINT);
+#endif
 
     /* Execute one instruction, including instruction fetch,
      * instruction decode, and the actual execution. */
     __attribute__((unused)) vaddr_t seq_pc = exec_once();
 
+#ifdef DEBUG
+    print_asm_on = false;
+    itrace_end();
+#endif
+
 #if defined(DIFF_TEST)
   difftest_step(ori_pc, cpu.pc);
 #endif
 
 #ifdef DEBUG
-  if (g_nr_guest_instr < LOG_MAX) {
-    asm_print(ori_pc, seq_pc - ori_pc, n < MAX_INSTR_TO_PRINT);
-  }
-  else if (g_nr_guest_instr == LOG_MAX) {
-    log_write("\n[Warning] To restrict the size of log file, "
-              "we do not record more instruction trace beyond this point.\n"
-              "To capture more trace, you can modify the LOG_MAX macro in %s\n\n", __FILE__);
-  }
+  asm_print(ori_pc, seq_pc - ori_pc, n < MAX_INSTR_TO_PRINT);
 
     /* TODO: check watchpoints here. */
     if (check()) nemu_state.state = NEMU_STOP;
@@ -65,13 +72,61 @@ void cpu_exec(uint64_t n) {
 
   g_nr_guest_instr ++;
 
-#ifdef HAS_IOE
-    extern void device_update();
-    device_update();
+    if (g_nr_guest_instr >= event_deadline) event_run();
+
+    if (nemu_state.state != NEMU_RUNNING) break;
+  }
+
+#if defined(DIFF_TEST)
+  // check what is left in the last batch
+  difftest_flush();
 #endif
+}
+#endif
+
+/* Without instruction trace and differential testing, there is no
+ * need to stop after every instruction. */
+static void exec_by_block(uint64_t n) {
+  while (n > 0) {
+    uint64_t slice = (n < NR_INSTR_PER_SLICE ? n : NR_INSTR_PER_SLICE);
+    if (event_deadline - g_nr_guest_instr < slice) slice = event_deadline - g_nr_guest_instr;
+    uint64_t nr = (slice > 0 ? isa_exec_blocks(slice) : 0);
+    g_nr_guest_instr += nr;
+    n -= nr;
+
+    if (g_nr_guest_instr >= event_deadline) event_run();
 
     if (nemu_state.state != NEMU_RUNNING) break;
   }
+}
+
+/* DEBUG builds trace every instruction and check watchpoints after it,
+ * unless the JIT is turned on and no watchpoint is set. DIFF_TEST builds
+ * always check every instruction. */
+static inline bool use_blocks(void) {
+#if defined(DIFF_TEST)
+  return false;
+#elif defined(DEBUG)
+  return jit_enabled() && !wp_exist();
+#else
+  return true;
+#endif
+}
+
+/* Simulate how the CPU works. */
+void cpu_exec(uint64_t n) {
+  switch (nemu_state.state) {
+    case NEMU_END: case NEMU_ABORT:
+      printf("Program execution has ended. To restart the program, exit NEMU and run again.\n");
+      return;
+    default: nemu_state.state = NEMU_RUNNING;
+  }
+  bp_resume();
+
+  if (use_blocks()) exec_by_block(n);
+#if defined(DEBUG) || defined(DIFF_TEST)
+  else exec_by_instr(n);
+#endif
 
   switch (nemu_state.state) {
     case NEMU_RUNNING: nemu_state.state = NEMU_STOP; break;
@@ -81,6 +136,9 @@ void cpu_exec(uint64_t n) {
           (nemu_state.state == NEMU_ABORT ? "\33[1;31mABORT" :
            (nemu_state.halt_ret == 0 ? "\33[1;32mHIT GOOD TRAP" : "\33[1;31mHIT BAD TRAP")),
           nemu_state.halt_pc);
+#ifdef DEBUG
+      if (nemu_state.state == NEMU_ABORT || nemu_state.halt_ret != 0) itrace_report();
+#endif
       monitor_statistic();
   }
 }
@@ -10,9 +10,8 @@
 #include <regex.h>
 #include <string.h>
 
-#define bool int
-#define true 1
-#define false 0
+#include "monitor/expr.h"
+
 #define OVERFLOW -1
 #define OK 1
 #define ERROR 0
@@ -46,7 +45,7 @@ static struct rule {
 } rules[] = {
   {" +", TK_NOTYPE},    // spaces
   {"0x[0-9a-f]+", TK_HEXADECIMAL},  // hexadecimal numbers
-  {"\\$[e,a,b,c,d,s].*?[x,p,i,l,h]", TK_GPR},    //GPR
+  {"\\$\\$?[a-z0-9]+", TK_GPR},    // register, `$$0' on mips32 and riscv32
   {"\\+", '+'},         // plus
   {"\\-", '-'},         // minus
   {"\\*", '*'},         // times
@@ -205,135 +204,172 @@ static bool make_token(char *e) {
   return true;
 }
 
-extern int check_parentheses(int p, int q, bool *success);
+extern bool check_parentheses(int p, int q, bool *success);
 extern int find_dominated_op(int p, int q, bool *success);
-extern uint32_t get_gpr(int p, bool *success);
-extern int htoi(char s[]);
 
-uint32_t eval(int p, int q, bool *success) {
-  //printf("p:%d, q:%d\n", p, q);
+/* An expression is compiled to code for a stack machine, so that it can
+ * be evaluated many times, as watchpoints are, without parsing it again.
+ * An operation pops its operands and pushes its result. */
+enum { OP_IMM = DEREF + 1, OP_REG8, OP_REG16, OP_REG32 };
+
+typedef struct {
+  int type;  // a token type of an operator, or one of the OP_*s above
+  union {
+    uint32_t imm;
+    const void *reg;
+  };
+} ExprOp;
+
+struct Expr {
+  int nr_op, depth;
+  ExprOp op[];
+};
+
+const void* isa_reg_str2addr(const char *s, int *width);
+
+static const void* gpr_lookup(const char *name, int *type) {
+  int width = 0;
+  const void *reg = isa_reg_str2addr(name + 1, &width);
+  *type = (width == 1 ? OP_REG8 : (width == 2 ? OP_REG16 : OP_REG32));
+  return reg;
+}
+
+static int cur_depth;
+
+static void emit(Expr *c, ExprOp op) {
+  c->op[c->nr_op ++] = op;
+  switch (op.type) {
+    case OP_IMM: case OP_REG8: case OP_REG16: case OP_REG32: cur_depth ++; break;
+    case DEREF: break;
+    default: cur_depth --;
+  }
+  if (cur_depth > c->depth) c->depth = cur_depth;
+}
+
+/* Compile tokens[p..q] into `c'. */
+static bool compile(int p, int q, Expr *c) {
   if (p > q) {
     Log("fatal error, the start of the sub-expression is bigger than its end.");
-    return 0;
+    return false;
   }
 
-  else if (p == q) {
-    //printf("p:%d, q:%d\n", p, q);
-    if (tokens[p].type == 259){
-      int number = htoi(tokens[p].str);
-      return number;
-    }
-    else if (tokens[p].type==260){
-      int number = 0;
-      for (int j=0; j<strlen(tokens[p].str); ++j){
-        number = number*10 + (tokens[p].str[j]-'0');
-        //printf("%d\n", number);
-      }
-      return number;
-    }
-    else if (tokens[p].type==258){
-      uint32_t gpr_value = get_gpr(p, success);
-      if (*success==true) return gpr_value;
-      else return 0;
-    }
-    else {
-      Log("Something wrong! The expression is illegal.");
-      return 0;
+  if (p == q) {
+    ExprOp op = { .type = OP_IMM };
+    switch (tokens[p].type) {
+      case TK_HEXADECIMAL: op.imm = htoi(tokens[p].str); break;
+      case TK_DECIMAL: op.imm = strtoul(tokens[p].str, NULL, 10); break;
+      case TK_GPR:
+        op.reg = gpr_lookup(tokens[p].str, &op.type);
+        if (op.reg == NULL) {
+          Log("No such register");
+          return false;
+        }
+        break;
+      default:
+        Log("Something wrong! The expression is illegal.");
+        return false;
     }
+    emit(c, op);
+    return true;
   }
-  
-  else{
-    //Log("Starting checking parentheses!\n");
-    if (check_parentheses(p, q, success) == 1) {
-      //printf("p:%d, q:%d\n", p, q);
-      /* The expression is surrounded by a matched pair of parentheses.
-      * If that is the case, just throw away the parentheses.
-      */
-      return eval(p + 1, q - 1, success);
-    }
 
-    else {
-      int op = find_dominated_op(p, q, success);
-      
-      if (tokens[op].type!=DEREF){
-        uint32_t val1 = eval(p, op - 1, success);
-        uint32_t val2 = eval(op + 1, q, success);
-
-        switch (tokens[op].type) {
-          case '+': return val1 + val2;
-          case '-': return val1 - val2;
-          case '*': return val1 * val2;
-          case '/': {
-            if (val2==0){
-              *success = false;
-              Log("ERROR: Division by zero");
-              return 0;
-            }
-            else return val1 / val2;
-          }
-          case 257: return val1 == val2;
-          case 261: return val1 && val2;
-          case 262: return val1 || val2;
-          case 263: return val1 != val2;
-          default: {
-            Log("Strange operation!");
-            *success = false;
-            return 0;
-          }
-        }
-      }
-      else{
-        int val1 = eval(op+1, q, success);
-			  return vaddr_read(val1,4);
-      }
-    }
+  bool success = true;
+  if (check_parentheses(p, q, &success) == 1) {
+    /* The expression is surrounded by a matched pair of parentheses.
+     * If that is the case, just throw away the parentheses.
+     */
+    return compile(p + 1, q - 1, c);
+  }
+  if (!success) return false;
+
+  int op = find_dominated_op(p, q, &success);
+  switch (tokens[op].type) {
+    case DEREF:
+      if (!compile(op + 1, q, c)) return false;
+      break;
+    case '+': case '-': case '*': case '/':
+    case TK_EQ: case TK_UEQ: case TK_AND: case TK_OR:
+      if (!compile(p, op - 1, c) || !compile(op + 1, q, c)) return false;
+      break;
+    default:
+      Log("Strange operation!");
+      return false;
   }
-  return 0;
+  emit(c, (ExprOp) { .type = tokens[op].type });
+  return true;
 }
 
-uint32_t expr(char *e, bool *success) {
-  if (make_token(e)!=true) {
+Expr* expr_compile(char *e, bool *success) {
+  if (make_token(e) != true) {
     Log("make token failed\n");
     *success = false;
-    return 0;
+    return NULL;
   }
 
-  int p = 0;
-  int q = nr_token-1;
-  return eval(p, q, success);
+  // every token is compiled to at most one operation
+  Expr *c = malloc(sizeof(Expr) + sizeof(ExprOp) * nr_token);
+  assert(c != NULL);
+  c->nr_op = c->depth = 0;
+  cur_depth = 0;
+  if (!compile(0, nr_token - 1, c)) {
+    free(c);
+    *success = false;
+    return NULL;
+  }
+  return c;
 }
 
-
-uint32_t get_gpr(int p, bool *success){
-  if (strcmp(tokens[p].str, "$eax")==0) return cpu.eax;
-  else if (strcmp(tokens[p].str, "$ecx")==0) return cpu.ecx;
-  else if (strcmp(tokens[p].str, "$edx")==0) return cpu.edx;
-  else if (strcmp(tokens[p].str, "$ebx")==0) return cpu.ebx;
-  else if (strcmp(tokens[p].str, "$eax")==0) return cpu.esp;
-  else if (strcmp(tokens[p].str, "$eax")==0) return cpu.ebp;
-  else if (strcmp(tokens[p].str, "$eax")==0) return cpu.esi;
-  else if (strcmp(tokens[p].str, "$eax")==0) return cpu.edi;
-  else if (strcmp(tokens[p].str, "$eax")==0) return cpu.gpr[0]._16;
-  else if (strcmp(tokens[p].str, "$eax")==0) return cpu.gpr[1]._16;
-  else if (strcmp(tokens[p].str, "$eax")==0) return cpu.gpr[2]._16;
-  else if (strcmp(tokens[p].str, "$eax")==0) return cpu.gpr[3]._16;
-  else if (strcmp(tokens[p].str, "$eax")==0) return cpu.gpr[4]._16;
-  else if (strcmp(tokens[p].str, "$eax")==0) return cpu.gpr[5]._16;
-  else if (strcmp(tokens[p].str, "$eax")==0) return cpu.gpr[6]._16;
-  else if (strcmp(tokens[p].str, "$eax")==0) return cpu.gpr[7]._16;
-  else if (strcmp(tokens[p].str, "$eax")==0) return cpu.gpr[0]._8[0];
-  else if (strcmp(tokens[p].str, "$eax")==0) return cpu.gpr[0]._8[1];
-  else if (strcmp(tokens[p].str, "$eax")==0) return cpu.gpr[1]._8[0];
-  else if (strcmp(tokens[p].str, "$eax")==0) return cpu.gpr[1]._8[1];
-  else if (strcmp(tokens[p].str, "$eax")==0) return cpu.gpr[2]._8[0];
-  else if (strcmp(tokens[p].str, "$eax")==0) return cpu.gpr[2]._8[1];
-  else if (strcmp(tokens[p].str, "$eax")==0) return cpu.gpr[3]._8[0];
-  else if (strcmp(tokens[p].str, "$eax")==0) return cpu.gpr[3]._8[1];
-  else {
-    Log("No such register");
-    *success = false;
-    return 0;
+uint32_t expr_eval(const Expr *c, bool *success) {
+  uint32_t stack[c->depth];
+  int sp = 0, i;
+  for (i = 0; i < c->nr_op; i ++) {
+    const ExprOp *op = &c->op[i];
+    uint32_t val2 = (sp > 0 ? stack[sp - 1] : 0);
+    uint32_t *top = &stack[sp - 2];  // the first operand of a binary operation
+    switch (op->type) {
+      case OP_IMM: stack[sp ++] = op->imm; break;
+      case OP_REG8: stack[sp ++] = *(uint8_t *)op->reg; break;
+      case OP_REG16: stack[sp ++] = *(uint16_t *)op->reg; break;
+      case OP_REG32: stack[sp ++] = *(uint32_t *)op->reg; break;
+      case DEREF: stack[sp - 1] = vaddr_read(val2, 4); break;
+      case '+': *top += val2; sp --; break;
+      case '-': *top -= val2; sp --; break;
+      case '*': *top *= val2; sp --; break;
+      case '/':
+        if (val2 == 0) {
+          *success = false;
+          Log("ERROR: Division by zero");
+          return 0;
+        }
+        *top /= val2; sp --; break;
+      case TK_EQ: *top = (*top == val2); sp --; break;
+      case TK_UEQ: *top = (*top != val2); sp --; break;
+      case TK_AND: *top = (*top && val2); sp --; break;
+      case TK_OR: *top = (*top || val2); sp --; break;
+      default: assert(0);
+    }
   }
+  return stack[0];
+}
+
+/* Return true if `c' only reads memory at a constant address, as
+ * `*0x100000' does, with the address in `*addr'. */
+bool expr_deref_addr(const Expr *c, vaddr_t *addr) {
+  if (c->nr_op != 2 || c->op[0].type != OP_IMM || c->op[1].type != DEREF) return false;
+  *addr = c->op[0].imm;
+  return true;
+}
+
+void expr_free(Expr *c) {
+  free(c);
+}
+
+uint32_t expr(char *e, bool *success) {
+  Expr *c = expr_compile(e, success);
+  if (c == NULL) return 0;
+  uint32_t val = expr_eval(c, success);
+  expr_free(c);
+  return val;
 }
 
 
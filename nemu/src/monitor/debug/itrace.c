@@ -0,0 +1,133 @@
+#include "nemu.h"
+#include "monitor/itrace.h"
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <signal.h>
+
+/* Records are made by exec_wrapper() for each instruction it interprets,
+ * so the trace needs DEBUG, and is not made for code run by the JIT.
+ * The ring keeps the last ITRACE_NR instructions. `head' is only written
+ * by the CPU, and `tail' only by the writer thread, so neither needs a lock.
+ * Without a trace file, the ring is overwritten, and its last records are
+ * reported when the guest ends badly. */
+#define ITRACE_NR (1 << 20)
+#define NR_REPORT 10
+#define NR_GPR (sizeof(cpu.gpr) / sizeof(cpu.gpr[0]))
+
+ItraceRecord itrace_cur;
+
+static ItraceRecord ring[ITRACE_NR];
+static uint64_t head = 0, tail = 0, tail_seen = 0;
+static uint32_t gpr_old[NR_GPR];
+
+static FILE *trace_fp = NULL;
+static pthread_t writer;
+static bool writer_stop = false;
+
+extern const char *regsl[];
+
+void itrace_begin(uint32_t pc) {
+  itrace_cur.pc = pc;
+  itrace_cur.len = 0;
+  itrace_cur.flags = 0;
+  int i;
+  for (i = 0; i < NR_GPR; i ++) gpr_old[i] = cpu.gpr[i]._32;
+}
+
+void itrace_end(void) {
+  int i;
+  for (i = 0; i < NR_GPR; i ++) {
+    if (cpu.gpr[i]._32 != gpr_old[i]) {
+      itrace_cur.flags |= ITRACE_REG;
+      itrace_cur.reg = i;
+      itrace_cur.reg_val = cpu.gpr[i]._32;
+      break;
+    }
+  }
+
+  if (trace_fp != NULL && head - tail_seen == ITRACE_NR) {
+    // wait for the writer to make room
+    while (head - (tail_seen = __atomic_load_n(&tail, __ATOMIC_ACQUIRE)) == ITRACE_NR) {
+      sched_yield();
+    }
+  }
+  ring[head % ITRACE_NR] = itrace_cur;
+  __atomic_store_n(&head, head + 1, __ATOMIC_RELEASE);
+}
+
+/* Print the last records, which lead to the end of the guest. */
+void itrace_report(void) {
+  uint64_t n = (head < NR_REPORT ? head : NR_REPORT);
+  if (n == 0) return;
+  _Log("The last %d instructions:\n", (int)n);
+  uint64_t i;
+  for (i = head - n; i < head; i ++) {
+    char buf[128];
+    itrace_format(buf, sizeof(buf), &ring[i % ITRACE_NR], regsl, NULL);
+    _Log("%s\n", buf);
+  }
+}
+
+static void* writer_loop(void *arg) {
+  while (true) {
+    bool stop = __atomic_load_n(&writer_stop, __ATOMIC_ACQUIRE);
+    uint64_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    if (h == tail) {
+      if (stop) break;
+      usleep(1000);
+      continue;
+    }
+    // write up to the end of the ring at a time
+    uint64_t end = h;
+    if (end / ITRACE_NR != tail / ITRACE_NR) end = (tail / ITRACE_NR + 1) * ITRACE_NR;
+    fwrite(&ring[tail % ITRACE_NR], sizeof(ring[0]), end - tail, trace_fp);
+    __atomic_store_n(&tail, end, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+static void itrace_finish(void) {
+  if (trace_fp == NULL) return;
+  __atomic_store_n(&writer_stop, true, __ATOMIC_RELEASE);
+  pthread_join(writer, NULL);
+  fclose(trace_fp);
+  trace_fp = NULL;
+}
+
+/* A failed assertion aborts NEMU without running the atexit() functions,
+ * so report the last records and flush the trace here. This is not
+ * async-signal-safe, but NEMU is about to die anyway. */
+static void itrace_abort(int sig) {
+  signal(SIGABRT, SIG_DFL);
+  itrace_report();
+  itrace_finish();
+  fflush(NULL);
+  abort();
+}
+
+void init_itrace(const char *trace_file) {
+#ifndef DEBUG
+  if (trace_file != NULL) {
+    Log("Instruction trace is only recorded with DEBUG defined in include/common.h");
+  }
+  return;
+#endif
+
+  if (trace_file != NULL) {
+    trace_fp = fopen(trace_file, "wb");
+    Assert(trace_fp, "Can not open '%s'", trace_file);
+
+    ItraceHeader h = {};
+    memcpy(h.magic, ITRACE_MAGIC, sizeof(h.magic));
+    strncpy(h.isa, str(__ISA__), sizeof(h.isa));
+    fwrite(&h, sizeof(h), 1, trace_fp);
+
+    Assert(pthread_create(&writer, NULL, writer_loop, NULL) == 0, "Can not start the trace writer");
+    atexit(itrace_finish);
+    Log("Instruction trace: %s", trace_file);
+  }
+
+  signal(SIGABRT, itrace_abort);
+}
@@ -1,4 +1,6 @@
 #include "common.h"
+#include "monitor/itrace.h"
+#include "cpu/decode.h"
 #include <stdarg.h>
 
 FILE *log_fp = NULL;
@@ -9,8 +11,8 @@ void init_log(const char *log_file) {
   Assert(log_fp, "Can not open '%s'", log_file);
 }
 
-char log_bytebuf[80] = {};
 char log_asmbuf[80] = {};
+bool print_asm_on = false;
 static char tempbuf[256] = {};
 
 void strcatf(char *buf, const char *fmt, ...) {
@@ -21,14 +23,28 @@ void strcatf(char *buf, const char *fmt, ...) {
   strcat(buf, tempbuf);
 }
 
+const char* op_str(const Operand *op) {
+  // an instruction prints at most three operands
+  static char buf[3][40];
+  static int i = 0;
+  i = (i + 1) % 3;
+  isa_op_str(buf[i], sizeof(buf[i]), op);
+  return buf[i];
+}
+
+/* Print the instruction just executed to the screen. Every instruction
+ * is recorded by the binary trace instead of the log file. */
 void asm_print(vaddr_t ori_pc, int instr_len, bool print_flag) {
-  snprintf(tempbuf, sizeof(tempbuf), "%8x:   %s%*.s%s", ori_pc, log_bytebuf,
-      50 - (12 + 3 * instr_len), "", log_asmbuf);
-  log_write("%s\n", tempbuf);
   if (print_flag) {
+    char bytebuf[3 * ITRACE_MAX_INSTR + 1] = "";
+    int i;
+    for (i = 0; i < itrace_cur.len; i ++) {
+      sprintf(bytebuf + 3 * i, "%02x ", itrace_cur.instr[i]);
+    }
+    snprintf(tempbuf, sizeof(tempbuf), "%8x:   %s%*.s%s", ori_pc, bytebuf,
+        50 - (12 + 3 * instr_len), "", log_asmbuf);
     puts(tempbuf);
   }
 
-  log_bytebuf[0] = '\0';
   log_asmbuf[0] = '\0';
 }
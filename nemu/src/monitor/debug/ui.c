@@ -1,6 +1,8 @@
 #include "monitor/monitor.h"
 #include "monitor/expr.h"
 #include "monitor/watchpoint.h"
+#include "monitor/snapshot.h"
+#include "monitor/diff-test.h"
 #include "nemu.h"
 
 #include <stdlib.h>
@@ -49,8 +51,14 @@ static int cmd_x_N(char *args);
 
 static int cmd_w(char *args);
 
+static int cmd_b(char *args);
+
 static int cmd_d(char *args);
 
+static int cmd_save(char *args);
+
+static int cmd_load(char *args);
+
 
 static struct {
   char *name;
@@ -65,7 +73,10 @@ static struct {
   { "p", "Calculate the value of expression EXPR", cmd_p},
   { "x", "Calculate the value of expression EXPR and set as the starting memory address, print successive N 4 bytes in hexadecimal form", cmd_x_N},
   { "w", "When the value of EXPR changes, pause the program", cmd_w},
-  { "d", "Delete the watchpoint of index N", cmd_d}
+  { "b", "Pause the program before ADDR, if EXPR is given and not zero: b ADDR [if EXPR]", cmd_b},
+  { "d", "Delete the watchpoint or breakpoint of index N", cmd_d},
+  { "save", "Save the state of the machine to FILE", cmd_save},
+  { "load", "Restore the state of the machine from FILE", cmd_load}
 
 };
 
@@ -116,10 +127,10 @@ extern void isa_reg_display();
 static int cmd_info(char *args){
   char *arg = strtok(NULL, " ");
   if (arg==NULL){
-    printf("For example: 'info r'--display the state of register; 'info w'--display the state of watchpoint.");
+    printf("For example: 'info r'--display the state of register; 'info w' or 'info b'--display the state of watchpoints and breakpoints.");
     return 0;
   }
-  if (arg[0]=='w'){
+  if (arg[0]=='w' || arg[0]=='b'){
     info_wp_display();
   }
   if (arg[0]=='r'){
@@ -172,6 +183,12 @@ static int cmd_w(char *args){
   return 0;
 }
 
+static int cmd_b(char *args){
+  if (args == NULL) Log("Invalid Input");
+  else new_bp(args);
+  return 0;
+}
+
 static int cmd_d(char *args){
   if(args!=NULL){
     int num = atoi(args);
@@ -181,6 +198,23 @@ static int cmd_d(char *args){
   return 0;
 }
 
+static int cmd_save(char *args){
+  char *arg = strtok(NULL, " ");
+  if (arg == NULL) Log("Invalid Input");
+  else snapshot_save(arg);
+  return 0;
+}
+
+static int cmd_load(char *args){
+  char *arg = strtok(NULL, " ");
+  if (arg == NULL) Log("Invalid Input");
+  else if (snapshot_load(arg)) {
+    // the reference still has the state before loading
+    difftest_resync();
+  }
+  return 0;
+}
+
 void ui_mainloop(int is_batch_mode) {
   if (is_batch_mode) {
     cmd_c(NULL);
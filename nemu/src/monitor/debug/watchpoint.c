@@ -1,21 +1,31 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
 #include "monitor/watchpoint.h"
 #include "monitor/expr.h"
 
 #include <string.h>
 
-#define NR_WP 32
+#define NR_WP 256
 #define LEN_WP_NAME 32
+#define NR_BP_SLOT 256
 
 static WP wp_pool[NR_WP] = {};
 static WP *head = NULL, *free_ = NULL; // head用于组织使用中的监视点结构, free_用于组织空闲的监视点结构
 
+static WP *bp_table[NR_BP_SLOT] = {};
+int nr_bp = 0;
+static bool bp_skip = false;
+
 void init_wp_pool() {
   int i;
   for (i = 0; i < NR_WP; i ++) {
     wp_pool[i].NO = i;
     wp_pool[i].next = &wp_pool[i + 1];
     wp_pool[i].exp[0] = '\0';
+    wp_pool[i].code = NULL;
     wp_pool[i].value = 0;
+    wp_pool[i].is_mem = false;
+    wp_pool[i].is_bp = false;
   }
   wp_pool[NR_WP - 1].next = NULL;
 
@@ -25,34 +35,144 @@ void init_wp_pool() {
 
 /* TODO: Implement the functionality of watchpoint */
 
-void new_wp(char *args){
-  WP *p;
+void isa_memory_changed(void);
+bool isa_paging_enabled(void);
+
+/* A watchpoint on a word of pmem, `*addr', watches the page of the word,
+ * and is checked only when the page is stored to, instead of after every
+ * instruction. With paging, the virtual address may not be the physical
+ * page, so it is checked after every instruction as others are. */
+static inline bool wp_on_store(WP *p) {
+  return p->is_mem && !isa_paging_enabled();
+}
+
+static WP* alloc_wp(char *args){
   if (free_ == NULL){
     panic("No more watchpoints.");
   }
+  WP *p = free_;
+  free_ = p->next;
+  p->next = NULL;
+  if (head == NULL){
+    head = p;
+  }
   else {
-    p = free_;
-    free_ = p->next;
-    p->next = NULL;
-    if (head == NULL){
-      head = p;
-    }
-    else {
-      WP *q = head;
-      while (q->next!=NULL) q = q->next;
-      q->next = p;
-    }
-    strncpy(p->exp, args, LEN_WP_NAME);
-    bool success = true;
-    p->value = expr(args, &success);
-    Log("Watch point %d is built, exp is %s, value is %d.", p->NO, p->exp, p->value);
+    WP *q = head;
+    while (q->next!=NULL) q = q->next;
+    q->next = p;
+  }
+  strncpy(p->exp, args, LEN_WP_NAME - 1);
+  p->exp[LEN_WP_NAME - 1] = '\0';
+  return p;
+}
+
+void new_wp(char *args){
+  bool success = true;
+  Expr *code = expr_compile(args, &success);
+  if (code == NULL){
+    Log("Bad expression '%s'.", args);
+    return;
   }
+  WP *p = alloc_wp(args);
+  p->code = code;
+  p->value = expr_eval(code, &success);
+  vaddr_t addr;
+  p->is_mem = (expr_deref_addr(code, &addr) && pmem_host(addr) != NULL && pmem_host(addr + 3) != NULL);
+  if (p->is_mem) {
+    p->addr = addr;
+    pmem_watch(addr, 4);
+  }
+  Log("Watch point %d is built, exp is %s, value is %d.", p->NO, p->exp, p->value);
   return;
 }
 
+static inline WP** bp_slot(vaddr_t pc) {
+  return &bp_table[(pc ^ (pc >> 8)) % NR_BP_SLOT];
+}
+
+/* b ADDR [if EXPR] */
+void new_bp(char *args){
+  bool success = true;
+  char *cond = strstr(args, " if ");
+  if (cond != NULL) *cond = '\0';
+  vaddr_t pc = expr(args, &success);
+  if (!success){
+    Log("Bad address '%s'.", args);
+    return;
+  }
+  Expr *code = NULL;
+  if (cond != NULL) {
+    code = expr_compile(cond + 4, &success);
+    if (code == NULL){
+      Log("Bad condition '%s'.", cond + 4);
+      return;
+    }
+    *cond = ' ';
+  }
+
+  WP *p = alloc_wp(args);
+  p->is_bp = true;
+  p->pc = pc;
+  p->code = code;
+  p->value = 0;
+  WP **slot = bp_slot(pc);
+  p->bp_next = *slot;
+  *slot = p;
+  nr_bp ++;
+  // split the translated blocks at the breakpoint
+  isa_memory_changed();
+  Log("Breakpoint %d is built at 0x%08x.", p->NO, pc);
+}
+
+bool bp_is_set(vaddr_t pc) {
+  if (likely(nr_bp == 0)) return false;
+  WP *p;
+  for (p = *bp_slot(pc); p != NULL; p = p->bp_next) {
+    if (p->pc == pc) return true;
+  }
+  return false;
+}
+
+/* Do not stop at the breakpoint where the CPU is resumed. */
+void bp_resume(void) {
+  bp_skip = true;
+}
+
+bool bp_hit_slow(vaddr_t pc) {
+  bool skip = bp_skip;
+  bp_skip = false;
+  if (skip) return false;
+
+  bool hit = false;
+  bool success = true;
+  WP *p;
+  for (p = *bp_slot(pc); p != NULL; p = p->bp_next) {
+    if (p->pc != pc || (p->code != NULL && expr_eval(p->code, &success) == 0)) continue;
+    p->value ++;
+    Log("Breakpoint %d at 0x%08x, hit %d time(s).", p->NO, pc, p->value);
+    hit = true;
+  }
+  if (hit) nemu_state.state = NEMU_STOP;
+  return hit;
+}
+
 void free_wp(WP *wp){
   Log("Free watch point %d.", wp->NO);
   wp->next = NULL;
+  expr_free(wp->code);
+  wp->code = NULL;
+  if (wp->is_bp) {
+    WP **q = bp_slot(wp->pc);
+    while (*q != wp) q = &(*q)->bp_next;
+    *q = wp->bp_next;
+    nr_bp --;
+    wp->is_bp = false;
+    isa_memory_changed();
+  }
+  if (wp->is_mem) {
+    pmem_unwatch(wp->addr, 4);
+    wp->is_mem = false;
+  }
   if (free_ == NULL){
     free_ = wp;
   }
@@ -67,7 +187,10 @@ void free_wp(WP *wp){
 void delete_wp(int num){
   WP *p = head;
   bool is_found = false;
-  if (p->NO == num){
+  if (p == NULL){
+    // no watchpoint is in use
+  }
+  else if (p->NO == num){
     is_found = true;
     head = head->next;
     free_wp(p);
@@ -90,6 +213,11 @@ void delete_wp(int num){
   return;
 }
 
+static void wp_display(WP *p){
+  if (p->is_bp) printf("%d\tb %s\thit %d time(s)\t\n", p->NO, p->exp, p->value);
+  else printf("%d\t%s\t%d\t\n", p->NO, p->exp, p->value);
+}
+
 void info_wp_display(){
   WP *p = head;
   printf("NO\texpression\tcurrent value\t\n");
@@ -97,27 +225,53 @@ void info_wp_display(){
     printf("No watch point is in use.\n");
   }
   else {
-    printf("%d\t%s\t%d\t\n", p->NO, p->exp, p->value);
+    wp_display(p);
     while (p->next != NULL){
       p = p->next;
-      printf("%d\t%s\t%d\t\n", p->NO, p->exp, p->value);
+      wp_display(p);
     }
   }
   return;
 }
 
+bool wp_exist(void) {
+  return head != NULL;
+}
+
 bool check(){
-  WP *p = head;
+  WP *p;
   bool flag = false;
   bool success = true;
-  while (p->next != NULL){
-    int cur_value = expr(p->exp, &success);
+  for (p = head; p != NULL; p = p->next){
+    if (p->is_bp || wp_on_store(p)) continue;
+    uint32_t cur_value = expr_eval(p->code, &success);
     if (cur_value != p->value){
       flag = true;
       Log("Value of watch point %d has changed\nOld value: %d\nNew value: %d\n", p->NO, p->value, cur_value);
+      p->value = cur_value;
     }
-    p = p->next;
   }
   if (flag == true) return true;
   else return false;
-}
\ No newline at end of file
+}
+
+/* Called after a store to [addr, addr + len) in a watched page. */
+void wp_store(paddr_t addr, int len) {
+  WP *p;
+  bool flag = false;
+  bool success = true;
+  for (p = head; p != NULL; p = p->next){
+    if (!wp_on_store(p) || (addr - p->addr >= 4 && p->addr - addr >= len)) continue;
+    uint32_t cur_value = expr_eval(p->code, &success);
+    if (cur_value != p->value){
+      flag = true;
+      Log("Value of watch point %d has changed\nOld value: %d\nNew value: %d\n", p->NO, p->value, cur_value);
+      p->value = cur_value;
+    }
+  }
+  if (flag && nemu_state.state == NEMU_RUNNING) {
+    nemu_state.state = NEMU_STOP;
+    // drop the translated blocks, so that the CPU stops right after this instruction
+    isa_memory_changed();
+  }
+}
@@ -2,16 +2,82 @@
 
 #include "nemu.h"
 #include "monitor/monitor.h"
+#include "monitor/diff-hash.h"
 
 void (*ref_difftest_memcpy_from_dut)(paddr_t dest, void *src, size_t n) = NULL;
 void (*ref_difftest_getregs)(void *c) = NULL;
 void (*ref_difftest_setregs)(const void *c) = NULL;
 void (*ref_difftest_exec)(uint64_t n) = NULL;
+void (*ref_difftest_exec_to)(uint64_t n, uint32_t pc, uint64_t hits) = NULL;
+uint64_t (*ref_difftest_memhash)(paddr_t addr, size_t n) = NULL;
 
 static bool is_skip_ref = false;
 static int skip_dut_nr_instr = 0;
 static bool is_detach = false;
 
+/* Instructions are checked in batches. The reference executes a whole
+ * batch at once, and the registers are only compared at its end. On a
+ * mismatch, both sides go back to the start of the batch, which is then
+ * stepped one instruction at a time to find the first wrong one. To go
+ * back, the old contents of memory stored to during the batch are logged.
+ *
+ * The pc after each instruction of the batch is also recorded, so that a
+ * reference which runs faster to a breakpoint than by single steps can be
+ * told where the batch ends (see ref_exec_batch()).
+ */
+#define DIFFTEST_BATCH 256
+#define STORE_LOG_SIZE (64 * 1024)
+
+typedef struct {
+  uint8_t *host;
+  int len;
+} StoreLog;
+
+static int nr_pending = 0;
+static vaddr_t batch_pc[DIFFTEST_BATCH];
+static CPU_state batch_start, dut_last;
+static StoreLog store_log[STORE_LOG_SIZE / 4];
+static uint8_t store_data[STORE_LOG_SIZE];
+static int nr_store = 0, store_data_len = 0;
+static bool store_log_full = false, store_log_off = false;
+static int instr_store = 0;  // the first store of the current instruction
+#define NR_INSTR_STORE 16     // at most so many stores of one instruction are kept
+
+/* Optionally, memory is also compared every `mem_check_every' instructions,
+ * by the hashes of the pages stored to since the last check. */
+#define NR_PMEM_PAGE (PMEM_SIZE / PAGE_SIZE)
+
+extern uint64_t g_nr_guest_instr;
+static uint64_t mem_check_every = 0, mem_check_next = 0, mem_check_last = 0;
+static bool page_dirty[NR_PMEM_PAGE];
+static uint32_t dirty_page[NR_PMEM_PAGE];
+static int nr_dirty_page = 0;
+
+#ifdef DIFF_TEST
+/* Called before `len' bytes at `host' in pmem are stored to. */
+void difftest_log_store(void *host, int len) {
+  if (mem_check_every > 0) {
+    uint32_t page = host_to_guest(host) / PAGE_SIZE;
+    uint32_t last = host_to_guest(host + len - 1) / PAGE_SIZE;
+    for (; page <= last; page ++) {
+      if (!page_dirty[page]) {
+        page_dirty[page] = true;
+        dirty_page[nr_dirty_page ++] = page;
+      }
+    }
+  }
+
+  if (store_log_off) return;
+  if (nr_store == STORE_LOG_SIZE / 4 || store_data_len + len > STORE_LOG_SIZE) {
+    store_log_full = true;
+    return;
+  }
+  store_log[nr_store ++] = (StoreLog) { .host = host, .len = len };
+  memcpy(store_data + store_data_len, host, len);
+  store_data_len += len;
+}
+#endif
+
 // this is used to let ref skip instructions which
 // can not produce consistent behavior with NEMU
 void difftest_skip_ref() {
@@ -25,6 +91,8 @@ void difftest_skip_ref() {
 //   Let REF run `nr_ref` instructions first.
 //   We expect that DUT will catch up with REF within `nr_dut` instructions.
 void difftest_skip_dut(int nr_ref, int nr_dut) {
+  void difftest_flush(void);
+  difftest_flush();
   skip_dut_nr_instr += nr_dut;
 
   while (nr_ref -- > 0) {
@@ -33,9 +101,11 @@ void difftest_skip_dut(int nr_ref, int nr_dut) {
 }
 
 bool isa_difftest_checkregs(CPU_state *ref_r, vaddr_t pc);
+void isa_difftest_syncregs(void);
 void isa_difftest_attach(void);
+void isa_memory_changed(void);
 
-void init_difftest(char *ref_so_file, long img_size) {
+void init_difftest(char *ref_so_file, long img_size, int mem_every) {
 #ifndef DIFF_TEST
   return;
 #endif
@@ -58,9 +128,20 @@ void init_difftest(char *ref_so_file, long img_size) {
   ref_difftest_exec = dlsym(handle, "difftest_exec");
   assert(ref_difftest_exec);
 
+  // optional
+  ref_difftest_exec_to = dlsym(handle, "difftest_exec_to");
+
   void (*ref_difftest_init)(void) = dlsym(handle, "difftest_init");
   assert(ref_difftest_init);
 
+  if (mem_every > 0) {
+    ref_difftest_memhash = dlsym(handle, "difftest_memhash");
+    Assert(ref_difftest_memhash, "%s can not compare memory", ref_so_file);
+    mem_check_every = mem_every;
+    mem_check_next = mem_every;
+    Log("Memory is compared every %d instructions", mem_every);
+  }
+
   Log("Differential testing: \33[1;32m%s\33[0m", "ON");
   Log("The result of every instruction will be compared with %s. "
       "This will help you a lot for debugging, but also significantly reduce the performance. "
@@ -68,7 +149,9 @@ void init_difftest(char *ref_so_file, long img_size) {
 
   ref_difftest_init();
   ref_difftest_memcpy_from_dut(PC_START, guest_to_host(IMAGE_START), img_size);
+  isa_difftest_syncregs();
   ref_difftest_setregs(&cpu);
+  dut_last = cpu;
 }
 
 static void checkregs(CPU_state *ref, vaddr_t pc) {
@@ -80,6 +163,170 @@ static void checkregs(CPU_state *ref, vaddr_t pc) {
   }
 }
 
+/* Undo the stores in the batch, and bring both sides back to its start. */
+static void batch_rewind(void) {
+  int i;
+  for (i = nr_store - 1; i >= 0; i --) {
+    store_data_len -= store_log[i].len;
+    memcpy(store_log[i].host, store_data + store_data_len, store_log[i].len);
+  }
+  isa_memory_changed();
+  for (i = 0; i < nr_store; i ++) {
+    ref_difftest_memcpy_from_dut(host_to_guest(store_log[i].host), store_log[i].host, store_log[i].len);
+  }
+  cpu = batch_start;
+  isa_difftest_syncregs();
+  ref_difftest_setregs(&cpu);
+}
+
+/* Step the batch again one instruction at a time, and stop at the first
+ * instruction with a mismatch. */
+static void batch_bisect(int nr) {
+  vaddr_t exec_once(void);
+  CPU_state ref_r;
+  store_log_off = true;
+  while (nr -- > 0) {
+    vaddr_t ori_pc = cpu.pc;
+    exec_once();
+    ref_difftest_exec(1);
+    ref_difftest_getregs(&ref_r);
+    checkregs(&ref_r, ori_pc);
+    if (nemu_state.state == NEMU_ABORT) break;
+  }
+  store_log_off = false;
+}
+
+/* Let the reference execute the `n' pending instructions. With
+ * difftest_exec_to(), it steps the first one, and then runs to the end
+ * of the batch, which is the `hits'-th time the final pc is reached. */
+static void ref_exec_batch(int n) {
+  if (ref_difftest_exec_to == NULL) {
+    ref_difftest_exec(n);
+    return;
+  }
+
+  vaddr_t pc = batch_pc[n - 1];
+  uint64_t hits = 0;
+  int i;
+  for (i = 1; i < n; i ++) {
+    if (batch_pc[i] == pc) hits ++;
+  }
+  ref_difftest_exec_to(n, pc, hits);
+}
+
+static inline void store_log_reset(void) {
+  nr_store = store_data_len = 0;
+  store_log_full = false;
+}
+
+/* Check the pending instructions, whose result should be `dut'. */
+static void batch_check(CPU_state *dut) {
+  if (nr_pending == 0) return;
+
+  CPU_state ref_r, cur = cpu;
+  ref_exec_batch(nr_pending);
+  ref_difftest_getregs(&ref_r);
+
+  cpu = *dut;
+  bool ok = isa_difftest_checkregs(&ref_r, cpu.pc);
+  cpu = cur;
+
+  if (!ok) {
+    if (store_log_full) {
+      Log("mismatch within the last %d instructions", nr_pending);
+      cpu = *dut;
+      checkregs(&ref_r, cpu.pc);
+      cpu = cur;
+    }
+    else {
+      Log("mismatch within the last %d instructions, stepping them again", nr_pending);
+      batch_rewind();
+      batch_bisect(nr_pending);
+      if (nemu_state.state != NEMU_ABORT) {
+        // the reference does not behave the same way twice
+        Log("the mismatch is not reproduced by stepping");
+        nemu_state.state = NEMU_ABORT;
+        nemu_state.halt_pc = cpu.pc;
+      }
+    }
+  }
+
+  nr_pending = 0;
+  store_log_reset();
+}
+
+/* Find the first different byte in [addr, addr + n), which is known to
+ * be different as a whole. */
+static paddr_t mem_bisect(paddr_t addr, size_t n) {
+  while (n > 1) {
+    size_t half = n / 2;
+    if (ref_difftest_memhash(addr, half) != diff_hash(guest_to_host(addr), half)) n = half;
+    else {
+      addr += half;
+      n -= half;
+    }
+  }
+  return addr;
+}
+
+/* Copy the memory which may have been stored to since the last check
+ * to the reference, when the store log is not complete. Without the
+ * dirty pages, all of pmem is copied. */
+static void ref_sync_dirty(void) {
+  int i;
+  if (mem_check_every == 0) {
+    ref_difftest_memcpy_from_dut(0, guest_to_host(0), PMEM_SIZE);
+    return;
+  }
+  for (i = 0; i < nr_dirty_page; i ++) {
+    paddr_t addr = dirty_page[i] * PAGE_SIZE;
+    ref_difftest_memcpy_from_dut(addr, guest_to_host(addr), PAGE_SIZE);
+  }
+}
+
+/* Compare the pages stored to since the last check. */
+static void mem_check(void) {
+  bool found = false;
+  paddr_t first = 0;
+  int i;
+  for (i = 0; i < nr_dirty_page; i ++) {
+    paddr_t addr = dirty_page[i] * PAGE_SIZE;
+    if ((!found || addr < first) &&
+        ref_difftest_memhash(addr, PAGE_SIZE) != diff_hash(guest_to_host(addr), PAGE_SIZE)) {
+      found = true;
+      first = addr;
+    }
+    page_dirty[dirty_page[i]] = false;
+  }
+  nr_dirty_page = 0;
+
+  if (found) {
+    paddr_t addr = mem_bisect(first, PAGE_SIZE);
+    Log("memory is different at paddr = 0x%08x, wrong = 0x%02x, "
+        "since the check after %ld instructions",
+        addr, *(uint8_t *)guest_to_host(addr), mem_check_last);
+    nemu_state.state = NEMU_ABORT;
+    nemu_state.halt_pc = cpu.pc;
+  }
+
+  mem_check_last = g_nr_guest_instr;
+  mem_check_next = g_nr_guest_instr + mem_check_every;
+}
+
+static inline void mem_check_if_due(void) {
+  if (mem_check_every > 0 && nr_pending == 0 && skip_dut_nr_instr == 0 &&
+      g_nr_guest_instr >= mem_check_next && nemu_state.state != NEMU_ABORT) {
+    mem_check();
+  }
+}
+
+/* Check the instructions executed so far. */
+void difftest_flush(void) {
+  if (is_detach) return;
+  batch_check(&cpu);
+  mem_check_if_due();
+}
+
 void difftest_step(vaddr_t ori_pc, vaddr_t next_pc) {
   CPU_state ref_r;
 
@@ -90,28 +337,78 @@ void difftest_step(vaddr_t ori_pc, vaddr_t next_pc) {
     if (ref_r.pc == next_pc) {
       checkregs(&ref_r, next_pc);
       skip_dut_nr_instr = 0;
-      return;
     }
-    skip_dut_nr_instr --;
-    if (skip_dut_nr_instr == 0)
-      panic("can not catch up with ref.pc = %x at pc = %x", ref_r.pc, ori_pc);
-    return;
+    else {
+      skip_dut_nr_instr --;
+      if (skip_dut_nr_instr == 0)
+        panic("can not catch up with ref.pc = %x at pc = %x", ref_r.pc, ori_pc);
+    }
   }
+  else if (is_skip_ref) {
+    // save the stores of this instruction, since the check below resets the log
+    StoreLog instr_log[NR_INSTR_STORE];
+    int i, nr = nr_store - instr_store;
+    bool logged = !store_log_full && !store_log_off && nr <= NR_INSTR_STORE;
+    if (logged) memcpy(instr_log, store_log + instr_store, sizeof(instr_log[0]) * nr);
+
+    // the instructions before this one are checked against the state before it
+    batch_check(&dut_last);
 
-  if (is_skip_ref) {
     // to skip the checking of an instruction, just copy the reg state to reference design
+    isa_difftest_syncregs();
     ref_difftest_setregs(&cpu);
+    // as well as the memory it stores to
+    if (logged) {
+      for (i = 0; i < nr; i ++) {
+        ref_difftest_memcpy_from_dut(host_to_guest(instr_log[i].host), instr_log[i].host, instr_log[i].len);
+      }
+    }
+    else ref_sync_dirty();
     is_skip_ref = false;
-    return;
+  }
+  else {
+    if (nr_pending == 0) batch_start = dut_last;
+    batch_pc[nr_pending ++] = next_pc;
+    if (nr_pending == DIFFTEST_BATCH || store_data_len > STORE_LOG_SIZE / 2) {
+      batch_check(&cpu);
+    }
   }
 
-  ref_difftest_exec(1);
-  ref_difftest_getregs(&ref_r);
+  // a new batch starts from here
+  if (nr_pending == 0) {
+    store_log_reset();
+    mem_check_if_due();
+  }
+  dut_last = cpu;
+  instr_store = nr_store;
+}
+
+/* Copy all of pmem and the registers to the reference, after the state
+ * of the machine is replaced, e.g. by loading a snapshot. The instructions
+ * before are not checked any more. */
+void difftest_resync(void) {
+  if (ref_difftest_memcpy_from_dut == NULL || is_detach) return;
 
-  checkregs(&ref_r, ori_pc);
+  is_skip_ref = false;
+  skip_dut_nr_instr = 0;
+  nr_pending = 0;
+  store_log_reset();
+  instr_store = 0;
+
+  int i;
+  for (i = 0; i < nr_dirty_page; i ++) page_dirty[dirty_page[i]] = false;
+  nr_dirty_page = 0;
+  mem_check_last = g_nr_guest_instr;
+  mem_check_next = g_nr_guest_instr + mem_check_every;
+
+  ref_difftest_memcpy_from_dut(PC_START - IMAGE_START, guest_to_host(0), PMEM_SIZE);
+  isa_difftest_syncregs();
+  ref_difftest_setregs(&cpu);
+  dut_last = cpu;
 }
 
 void difftest_detach() {
+  difftest_flush();
   is_detach = true;
 }
 
@@ -123,6 +420,10 @@ void difftest_attach() {
   is_detach = false;
   is_skip_ref = false;
   skip_dut_nr_instr = 0;
+  nr_pending = 0;
+  store_log_reset();
+  instr_store = 0;
 
   isa_difftest_attach();
+  dut_last = cpu;
 }
@@ -1,18 +1,30 @@
 #include "nemu.h"
 #include "monitor/diff-test.h"
 #include "isa/diff-test.h"
+#include "monitor/diff-hash.h"
 
 void cpu_exec(uint64_t);
+void isa_difftest_syncregs(void);
+void isa_memory_changed(void);
 
 void difftest_memcpy_from_dut(paddr_t dest, void *src, size_t n) {
   memcpy(guest_to_host(dest), src, n);
+  // what is cached from the old contents of memory is stale now
+  isa_memory_changed();
+}
+
+uint64_t difftest_memhash(paddr_t addr, size_t n) {
+  return diff_hash(guest_to_host(addr), n);
 }
 
 void difftest_getregs(void *r) {
+  isa_difftest_syncregs();
   memcpy(r, &cpu, DIFFTEST_REG_SIZE);
 }
 
 void difftest_setregs(const void *r) {
+  // lazily evaluated state should not override what is copied in
+  isa_difftest_syncregs();
   memcpy(&cpu, r, DIFFTEST_REG_SIZE);
 }
 
@@ -1,25 +1,46 @@
 #include "nemu.h"
 #include "monitor/monitor.h"
+#include "monitor/snapshot.h"
+#include "monitor/diff-test.h"
 #include <unistd.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 void init_log(const char *log_file);
 void init_isa();
+void init_snapshot();
 void init_regex();
 void init_wp_pool();
-void init_device();
-void init_difftest(char *ref_so_file, long img_size);
+void init_device(bool headless, char *frame_file, int frame_every, bool frame_hash);
+void init_difftest(char *ref_so_file, long img_size, int mem_every);
+void init_jit(bool enable);
+void init_itrace(const char *trace_file);
+void init_event(void);
+void init_icount(int instr_per_us, bool enable_warp);
 
 static char *mainargs = "";
 static char *log_file = NULL;
+static char *itrace_file = NULL;
 static char *diff_so_file = NULL;
+static int diff_mem_every = 0;
 static char *img_file = NULL;
+static char *snapshot_file = NULL;
 static int is_batch_mode = false;
+static int use_jit = false;
+static int is_headless = false;
+static char *frame_file = NULL;
+static int frame_every = 1;
+static int frame_hash = false;
+static int icount = 0;
+static int icount_warp = false;
 
 static inline void welcome() {
 #ifdef DEBUG
   Log("Debug: \33[1;32m%s\33[0m", "ON");
-  Log("If debug mode is on, A log file will be generated to record every instruction NEMU executes. "
-      "This may lead to a large log file. "
+  Log("If debug mode is on, every instruction NEMU executes is recorded, and written to the file "
+      "given by --itrace. Decode it with tools/itrace-dump. Code run by --jit is not recorded. "
       "If it is not necessary, you can turn it off in include/common.h.");
 #else
   Log("Debug: \33[1;32m%s\33[0m", "OFF");
@@ -40,41 +61,86 @@ static inline long load_img() {
     memcpy(guest_to_host(IMAGE_START), isa_default_img, size);
   }
   else {
-    int ret;
-
-    FILE *fp = fopen(img_file, "rb");
-    Assert(fp, "Can not open '%s'", img_file);
+    int fd = open(img_file, O_RDONLY);
+    Assert(fd != -1, "Can not open '%s'", img_file);
 
     Log("The image is %s", img_file);
 
-    fseek(fp, 0, SEEK_END);
-    size = ftell(fp);
-
-    fseek(fp, 0, SEEK_SET);
-    ret = fread(guest_to_host(IMAGE_START), size, 1, fp);
-    assert(ret == 1);
+    struct stat st;
+    assert(fstat(fd, &st) == 0);
+    size = st.st_size;
+    Assert(size <= PMEM_SIZE - IMAGE_START, "'%s' is too large", img_file);
+
+    // the image is only read from the file as the guest touches it
+    if (!host_map_file(guest_to_host(IMAGE_START), size, fd, 0)) {
+      FILE *fp = fdopen(fd, "rb");
+      assert(fp);
+      int ret = fread(guest_to_host(IMAGE_START), size, 1, fp);
+      assert(size == 0 || ret == 1);
+      fclose(fp);
+      return size;
+    }
 
-    fclose(fp);
+    close(fd);
   }
   return size;
 }
 
+static inline void usage(const char *prog) {
+  panic("Usage: %s [-b] [-j|--jit] [-l log_file] [--itrace=file (DEBUG only, not with --jit)] "
+      "[-d ref_so [--diff-mem=N]] [--load=snapshot] [--headless] "
+      "[--frame-dump=file [--frame-every=N] [--frame-hash]] [--icount=N [--icount-warp]] [img_file]", prog);
+}
+
 static inline void parse_args(int argc, char *argv[]) {
+  const struct option table[] = {
+    {"batch", no_argument      , NULL, 'b'},
+    {"log"  , required_argument, NULL, 'l'},
+    {"itrace"     , required_argument, NULL, 't'},
+    {"diff" , required_argument, NULL, 'd'},
+    {"diff-mem"   , required_argument, NULL, 'm'},
+    {"load"       , required_argument, NULL, 'L'},
+    {"args" , required_argument, NULL, 'a'},
+    {"jit"  , no_argument      , NULL, 'j'},
+    {"headless"   , no_argument      , NULL, 'H'},
+    {"frame-dump" , required_argument, NULL, 'f'},
+    {"frame-every", required_argument, NULL, 'n'},
+    {"frame-hash" , no_argument      , NULL, 'h'},  // no short option
+    {"icount"     , required_argument, NULL, 'i'},
+    {"icount-warp", no_argument      , NULL, 'w'},
+    {0      , 0                , NULL,  0 },
+  };
   int o;
-  while ( (o = getopt(argc, argv, "-bl:d:a:")) != -1) {
+  while ( (o = getopt_long(argc, argv, "-bl:t:d:m:L:a:jHf:n:i:w", table, NULL)) != -1) {
     switch (o) {
       case 'b': is_batch_mode = true; break;
+      case 'j': use_jit = true; break;
+      case 'H': is_headless = true; break;
+      case 'f': frame_file = optarg; break;
+      case 'n': frame_every = atoi(optarg); break;
+      case 'h': frame_hash = true; break;
+      case 'i': icount = atoi(optarg); break;
+      case 'w': icount_warp = true; break;
       case 'a': mainargs = optarg; break;
       case 'l': log_file = optarg; break;
+      case 't': itrace_file = optarg; break;
       case 'd': diff_so_file = optarg; break;
+      case 'm': diff_mem_every = atoi(optarg); break;
+      case 'L': snapshot_file = optarg; break;
       case 1:
                 if (img_file != NULL) Log("too much argument '%s', ignored", optarg);
                 else img_file = optarg;
                 break;
       default:
-                panic("Usage: %s [-b] [-l log_file] [img_file]", argv[0]);
+                usage(argv[0]);
     }
   }
+
+  // the trace is recorded for each instruction interpreted
+  if (itrace_file != NULL && use_jit) {
+    Log("--itrace can not be used with --jit");
+    usage(argv[0]);
+  }
 }
 
 char* get_mainargs(void) {
@@ -90,23 +156,45 @@ int init_monitor(int argc, char *argv[]) {
   /* Open the log file. */
   init_log(log_file);
 
+  /* Write the instruction trace in the background. */
+  init_itrace(itrace_file);
+
   /* Load the image to memory. */
   long img_size = load_img();
 
   /* Perform ISA dependent initialization. */
   init_isa();
 
+  /* Register the machine state to save in snapshots. */
+  init_snapshot();
+
   /* Compile the regular expressions. */
   init_regex();
 
   /* Initialize the watchpoint pool. */
   init_wp_pool();
 
+  /* Initialize the queue of device events. */
+  init_event();
+
+  /* Use deterministic virtual time if asked. */
+  init_icount(icount, icount_warp);
+
   /* Initialize devices. */
-  init_device();
+  init_device(is_headless, frame_file, frame_every, frame_hash);
+
+  /* Start from a snapshot instead of the image. */
+  if (snapshot_file != NULL) {
+    Assert(snapshot_load(snapshot_file), "Can not load snapshot '%s'", snapshot_file);
+  }
 
   /* Initialize differential testing. */
-  init_difftest(diff_so_file, img_size);
+  init_difftest(diff_so_file, img_size, diff_mem_every);
+  // the reference starts from all of memory instead of the image
+  if (snapshot_file != NULL) difftest_resync();
+
+  /* Translate hot blocks to host code. */
+  init_jit(use_jit);
 
   /* Display welcome message. */
   welcome();
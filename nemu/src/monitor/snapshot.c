@@ -0,0 +1,240 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/snapshot.h"
+#include "device/event.h"
+#include <stdlib.h>
+
+/* The snapshot file starts with a header, followed by each region: its
+ * name and size, the number of its non-zero pages and their indices, then
+ * the pages themselves. Pages which are zero are not stored, and are
+ * cleared on loading. The pages start at a page boundary of the file and
+ * each takes a whole page, so that they can be mapped into a region which
+ * is page-aligned, instead of being read. */
+
+#define SNAPSHOT_MAGIC "NEMUSNP2"
+#define LEN_NAME 16
+#define NR_REGION 16
+#define NR_HOOK 8
+
+typedef struct {
+  char name[LEN_NAME];
+  void *addr;
+  size_t size;
+  void (*loaded)(void);
+} Region;
+
+static Region region[NR_REGION];
+static int nr_region = 0;
+static void (*hook[NR_HOOK])(void);
+static int nr_hook = 0;
+
+void isa_memory_changed(void);
+
+void snapshot_register(const char *name, void *addr, size_t size, void (*loaded)(void)) {
+  Assert(nr_region < NR_REGION, "too many snapshot regions");
+  Assert(strlen(name) < LEN_NAME, "snapshot region name '%s' is too long", name);
+  Region *r = &region[nr_region ++];
+  memset(r->name, 0, LEN_NAME);
+  strcpy(r->name, name);
+  r->addr = addr;
+  r->size = size;
+  r->loaded = loaded;
+}
+
+void snapshot_add_hook(void (*loaded)(void)) {
+  Assert(nr_hook < NR_HOOK, "too many snapshot hooks");
+  hook[nr_hook ++] = loaded;
+}
+
+void init_snapshot(void) {
+  snapshot_register("cpu", &cpu, sizeof(cpu), NULL);
+  snapshot_register("nemu_state", &nemu_state, sizeof(nemu_state), NULL);
+  snapshot_register("instr", &g_nr_guest_instr, sizeof(g_nr_guest_instr), NULL);
+  // cached translations and decodings of memory are stale after loading
+  snapshot_register("pmem", pmem, PMEM_SIZE, isa_memory_changed);
+}
+
+static inline bool page_is_zero(const void *p, size_t size) {
+  const uint64_t *q = p;
+  size_t i;
+  for (i = 0; i < size / sizeof(*q); i ++) {
+    if (q[i] != 0) return false;
+  }
+  const uint8_t *b = p;
+  for (i = i * sizeof(*q); i < size; i ++) {
+    if (b[i] != 0) return false;
+  }
+  return true;
+}
+
+typedef struct {
+  char magic[8];
+  char isa[8];
+  uint32_t nr_region;
+} Header;
+
+static inline size_t page_len(Region *r, uint32_t idx) {
+  size_t len = r->size - (size_t)idx * PAGE_SIZE;
+  return (len > PAGE_SIZE ? PAGE_SIZE : len);
+}
+
+static inline bool region_mappable(Region *r) {
+  return ((uintptr_t)r->addr & PAGE_MASK) == 0 && (r->size & PAGE_MASK) == 0;
+}
+
+static inline long page_align(long off) {
+  return (off + PAGE_MASK) & ~(long)PAGE_MASK;
+}
+
+static bool save_region(FILE *fp, Region *r) {
+  uint32_t nr_page = (r->size + PAGE_SIZE - 1) / PAGE_SIZE;
+  uint32_t *idx = malloc(sizeof(*idx) * (nr_page + 1));
+  assert(idx != NULL);
+  uint32_t i, n = 0;
+  for (i = 0; i < nr_page; i ++) {
+    if (!page_is_zero(r->addr + (size_t)i * PAGE_SIZE, page_len(r, i))) idx[n ++] = i;
+  }
+
+  uint64_t size = r->size;
+  fwrite(r->name, LEN_NAME, 1, fp);
+  fwrite(&size, sizeof(size), 1, fp);
+  fwrite(&n, sizeof(n), 1, fp);
+  fwrite(idx, sizeof(*idx), n, fp);
+
+  static const uint8_t zero[PAGE_SIZE] = {};
+  long off = ftell(fp);
+  fwrite(zero, page_align(off) - off, 1, fp);
+  for (i = 0; i < n; i ++) {
+    size_t len = page_len(r, idx[i]);
+    fwrite(r->addr + (size_t)idx[i] * PAGE_SIZE, len, 1, fp);
+    fwrite(zero, PAGE_SIZE - len, 1, fp);
+  }
+
+  free(idx);
+  return !ferror(fp);
+}
+
+bool snapshot_save(const char *file) {
+  // write to a new file, since the old one may be mapped by snapshot_load()
+  char tmp[strlen(file) + 8];
+  sprintf(tmp, "%s.tmp", file);
+  FILE *fp = fopen(tmp, "wb");
+  if (fp == NULL) {
+    Log("Can not open '%s'", tmp);
+    return false;
+  }
+
+  Header h = { .nr_region = nr_region };
+  memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+  strncpy(h.isa, str(__ISA__), sizeof(h.isa));
+  fwrite(&h, sizeof(h), 1, fp);
+
+  bool ok = true;
+  int i;
+  for (i = 0; ok && i < nr_region; i ++) {
+    ok = save_region(fp, &region[i]);
+  }
+
+  ok &= !ferror(fp);
+  ok &= (fclose(fp) == 0);
+  ok = ok && (rename(tmp, file) == 0);
+  if (ok) Log("Saved a snapshot to %s", file);
+  else {
+    Log("Can not write '%s'", file);
+    remove(tmp);
+  }
+  return ok;
+}
+
+static bool load_region(FILE *fp, Region *r) {
+  char name[LEN_NAME];
+  uint64_t size;
+  uint32_t n;
+  if (fread(name, LEN_NAME, 1, fp) != 1 || fread(&size, sizeof(size), 1, fp) != 1 ||
+      fread(&n, sizeof(n), 1, fp) != 1) return false;
+  if (memcmp(name, r->name, LEN_NAME) != 0 || size != r->size) {
+    Log("Snapshot region '%.*s' of %ld bytes does not match '%s' of %ld bytes",
+        LEN_NAME, name, (long)size, r->name, (long)r->size);
+    return false;
+  }
+
+  uint32_t nr_page = (r->size + PAGE_SIZE - 1) / PAGE_SIZE;
+  if (n > nr_page) return false;
+  uint32_t idx[n + 1];
+  if (fread(idx, sizeof(*idx), n, fp) != n) return false;
+  uint32_t i;
+  for (i = 0; i < n; i ++) {
+    if (idx[i] >= nr_page || (i > 0 && idx[i] <= idx[i - 1])) return false;
+  }
+  long off = page_align(ftell(fp));
+
+  if (region_mappable(r)) {
+    // drop the old pages, and map the stored ones in runs of consecutive pages
+    host_map_zero(r->addr, r->size);
+    for (i = 0; i < n; ) {
+      uint32_t j = i + 1;
+      while (j < n && idx[j] == idx[j - 1] + 1) j ++;
+      void *p = r->addr + (size_t)idx[i] * PAGE_SIZE;
+      if (!host_map_file(p, (size_t)(j - i) * PAGE_SIZE, fileno(fp), off + (long)i * PAGE_SIZE)) {
+        if (fseek(fp, off + (long)i * PAGE_SIZE, SEEK_SET) != 0 ||
+            fread(p, (size_t)(j - i) * PAGE_SIZE, 1, fp) != 1) return false;
+      }
+      i = j;
+    }
+  }
+  else {
+    uint32_t next = 0;
+    for (i = 0; i <= n; i ++) {
+      uint32_t end = (i == n ? nr_page : idx[i]);
+      // do not touch the pages which are zero already
+      for (; next < end; next ++) {
+        uint8_t *p = r->addr + (size_t)next * PAGE_SIZE;
+        if (!page_is_zero(p, page_len(r, next))) memset(p, 0, page_len(r, next));
+      }
+      if (i == n) break;
+      if (fseek(fp, off + (long)i * PAGE_SIZE, SEEK_SET) != 0 ||
+          fread(r->addr + (size_t)idx[i] * PAGE_SIZE, page_len(r, idx[i]), 1, fp) != 1) return false;
+      next = idx[i] + 1;
+    }
+  }
+
+  return fseek(fp, off + (long)n * PAGE_SIZE, SEEK_SET) == 0;
+}
+
+bool snapshot_load(const char *file) {
+  FILE *fp = fopen(file, "rb");
+  if (fp == NULL) {
+    Log("Can not open '%s'", file);
+    return false;
+  }
+
+  Header h;
+  char isa[8] = {};
+  strncpy(isa, str(__ISA__), sizeof(isa));
+  if (fread(&h, sizeof(h), 1, fp) != 1 || memcmp(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic)) != 0 ||
+      memcmp(h.isa, isa, sizeof(isa)) != 0 || h.nr_region != nr_region) {
+    Log("'%s' is not a snapshot of this NEMU", file);
+    fclose(fp);
+    return false;
+  }
+
+  int i;
+  for (i = 0; i < nr_region; i ++) {
+    if (!load_region(fp, &region[i])) {
+      // the machine is now in a broken state
+      panic("Can not load snapshot region '%s' from %s", region[i].name, file);
+    }
+  }
+  fclose(fp);
+
+  for (i = 0; i < nr_region; i ++) {
+    if (region[i].loaded != NULL) region[i].loaded();
+  }
+  for (i = 0; i < nr_hook; i ++) hook[i]();
+
+  // the snapshot may be saved by a running NEMU
+  if (nemu_state.state == NEMU_RUNNING) nemu_state.state = NEMU_STOP;
+
+  Log("Loaded a snapshot from %s", file);
+  return true;
+}
@@ -0,0 +1,207 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../../include/monitor/itrace.h"
+
+static const char *x86_gpr[] = {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi"};
+
+static const char *mips32_gpr[] = {
+  "$0", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+  "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+  "s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+  "t8", "t9", "k0", "k1", "gp", "sp", "s8", "ra"
+};
+
+static const char *riscv32_gpr[] = {
+  "$0", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+  "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+  "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+  "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"
+};
+
+static struct {
+  const char *isa;
+  const char **gpr;
+  int nr_gpr;
+  const char *objdump_arch;  // the options of objdump for the machine
+  uint32_t nop;
+} isa_table[] = {
+  { "x86", x86_gpr, 8, "-m i386", 0x90909090 },
+  { "mips32", mips32_gpr, 32, "-m mips:isa32 -EL", 0x00000000 },
+  { "riscv32", riscv32_gpr, 32, "-m riscv:rv32", 0x00000013 },
+};
+
+#define NR_ISA (sizeof(isa_table) / sizeof(isa_table[0]))
+
+enum { BR_NONE, BR_REL, BR_REGION };
+
+/* The kind of the target of `mnemonic', if it is a direct branch. */
+static int branch_kind(const char *isa, const char *mnemonic, const char *operand) {
+  if (strcmp(isa, "x86") == 0) {
+    if (operand[0] == '*') return BR_NONE;  // indirect
+    return (mnemonic[0] == 'j' || strncmp(mnemonic, "call", 4) == 0 ||
+        strncmp(mnemonic, "loop", 4) == 0 ? BR_REL : BR_NONE);
+  }
+  if (strcmp(isa, "mips32") == 0) {
+    if (mnemonic[0] == 'b') return BR_REL;
+    return (strcmp(mnemonic, "j") == 0 || strcmp(mnemonic, "jal") == 0 ? BR_REGION : BR_NONE);
+  }
+  return (mnemonic[0] == 'b' || strcmp(mnemonic, "j") == 0 || strcmp(mnemonic, "jal") == 0 ? BR_REL : BR_NONE);
+}
+
+/* objdump computes the targets of branches from the offset of the slot,
+ * so move them to the pc of the record. */
+static void fix_target(char *text, const char *isa, uint32_t off, uint32_t pc) {
+  char mnemonic[16] = "";
+  int n = 0;
+  sscanf(text, "%15s %n", mnemonic, &n);
+  if (n == 0 || branch_kind(isa, mnemonic, text + n) == BR_NONE) return;
+
+  char *target = strrchr(text, ' ');
+  char *comma = strrchr(text, ',');
+  if (comma != NULL && comma > target) target = comma;
+  if (target == NULL || strncmp(target + 1, "0x", 2) != 0) return;
+  char *end;
+  uint32_t addr = strtoul(target + 1, &end, 16);
+  if (*end != '\0') return;
+
+  if (branch_kind(isa, mnemonic, text + n) == BR_REL) addr = addr - off + pc;
+  else addr = ((pc + 4) & 0xf0000000) | (addr & 0x0fffffff);
+  sprintf(target + 1, "0x%x", addr);
+}
+
+/* Records are disassembled in chunks by objdump. The instructions of a
+ * chunk are written to a file, each in a slot of ITRACE_MAX_INSTR bytes
+ * padded with nops, so that the one of record i is at i * ITRACE_MAX_INSTR.
+ * The objdump for other machines than the host is given by $OBJDUMP. */
+#define NR_CHUNK 4096
+#define LEN_DISASM 64
+
+static ItraceRecord chunk[NR_CHUNK];
+static char disasm[NR_CHUNK][LEN_DISASM];
+
+static bool disassemble(int nr, const char *isa, const char *objdump_arch, uint32_t nop) {
+  char file[] = "/tmp/itrace-dump-XXXXXX";
+  int fd = mkstemp(file);
+  if (fd < 0) {
+    perror("mkstemp");
+    return false;
+  }
+  FILE *fp = fdopen(fd, "wb");
+  int i, j;
+  for (i = 0; i < nr; i ++) {
+    uint8_t slot[ITRACE_MAX_INSTR];
+    for (j = 0; j < ITRACE_MAX_INSTR; j ++) slot[j] = nop >> (8 * (j % 4));
+    memcpy(slot, chunk[i].instr, chunk[i].len);
+    fwrite(slot, sizeof(slot), 1, fp);
+    disasm[i][0] = '\0';
+  }
+  fclose(fp);
+
+  const char *objdump = getenv("OBJDUMP");
+  char cmd[256];
+  snprintf(cmd, sizeof(cmd), "%s -D -b binary %s --insn-width=%d %s",
+      (objdump != NULL ? objdump : "objdump"), objdump_arch, ITRACE_MAX_INSTR, file);
+  fp = popen(cmd, "r");
+  if (fp == NULL) {
+    perror(cmd);
+    remove(file);
+    return false;
+  }
+
+  // the lines of instructions are "offset:\tbytes\tassembly"
+  char line[256];
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    unsigned long off;
+    char *bytes = strchr(line, '\t');
+    char *text = (bytes == NULL ? NULL : strchr(bytes + 1, '\t'));
+    if (text == NULL || sscanf(line, " %lx:", &off) != 1) continue;
+    if (off % ITRACE_MAX_INSTR != 0 || off / ITRACE_MAX_INSTR >= (unsigned long)nr) continue;
+    text[strcspn(text, "\n")] = '\0';
+    int k = off / ITRACE_MAX_INSTR;
+    snprintf(disasm[k], LEN_DISASM - 16, "%s", text + 1);
+    fix_target(disasm[k], isa, off, chunk[k].pc);
+  }
+
+  bool ok = (pclose(fp) == 0);
+  remove(file);
+  if (!ok) fprintf(stderr, "%s failed\n", cmd);
+  return ok;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "Usage: %s [-d] [-n last_N] [-p pc] trace_file\n"
+      "  -d  disassemble the instructions with objdump, or $OBJDUMP\n", name);
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+  long last = -1;
+  long pc = -1;
+  bool use_disasm = false;
+  int o;
+  while ((o = getopt(argc, argv, "dn:p:")) != -1) {
+    switch (o) {
+      case 'd': use_disasm = true; break;
+      case 'n': last = atol(optarg); break;
+      case 'p': pc = strtol(optarg, NULL, 16); break;
+      default: usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1) usage(argv[0]);
+
+  FILE *fp = fopen(argv[optind], "rb");
+  if (fp == NULL) {
+    perror(argv[optind]);
+    return 1;
+  }
+
+  ItraceHeader h;
+  if (fread(&h, sizeof(h), 1, fp) != 1 || memcmp(h.magic, ITRACE_MAGIC, sizeof(h.magic)) != 0) {
+    fprintf(stderr, "%s is not an instruction trace of NEMU\n", argv[optind]);
+    return 1;
+  }
+
+  size_t i;
+  for (i = 0; i < NR_ISA; i ++) {
+    if (strncmp(h.isa, isa_table[i].isa, sizeof(h.isa)) == 0) break;
+  }
+  if (i == NR_ISA) {
+    fprintf(stderr, "unknown ISA '%.*s'\n", (int)sizeof(h.isa), h.isa);
+    return 1;
+  }
+  const char **gpr = isa_table[i].gpr;
+  int nr_gpr = isa_table[i].nr_gpr;
+
+  if (last >= 0) {
+    fseek(fp, 0, SEEK_END);
+    long nr = (ftell(fp) - (long)sizeof(h)) / sizeof(ItraceRecord);
+    if (last > nr) last = nr;
+    fseek(fp, sizeof(h) + (nr - last) * sizeof(ItraceRecord), SEEK_SET);
+  }
+
+  char buf[256];
+  int nr;
+  do {
+    ItraceRecord *r = chunk;
+    for (nr = 0; nr < NR_CHUNK && fread(r, sizeof(*r), 1, fp) == 1; ) {
+      if (pc != -1 && r->pc != (uint32_t)pc) continue;
+      if ((r->flags & ITRACE_REG) && r->reg >= nr_gpr) r->flags &= ~ITRACE_REG;
+      if (r->len > ITRACE_MAX_INSTR) r->len = ITRACE_MAX_INSTR;
+      r ++;
+      nr ++;
+    }
+    if (use_disasm && nr > 0 && !disassemble(nr, isa_table[i].isa, isa_table[i].objdump_arch, isa_table[i].nop)) return 1;
+
+    int k;
+    for (k = 0; k < nr; k ++) {
+      itrace_format(buf, sizeof(buf), &chunk[k], gpr, (use_disasm ? disasm[k] : NULL));
+      puts(buf);
+    }
+  } while (nr == NR_CHUNK);
+
+  fclose(fp);
+  return 0;
+}
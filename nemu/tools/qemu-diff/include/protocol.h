@@ -27,6 +27,8 @@ uint64_t gdb_decode_hex_str(uint8_t *bytes);
 
 uint8_t hex_encode(uint8_t digit);
 
+size_t gdb_encode_binary(uint8_t *dst, size_t dst_size, const uint8_t *src, size_t *size);
+
 struct gdb_conn *gdb_begin_inet(const char *addr, uint16_t port);
 
 void gdb_end(struct gdb_conn *conn);
@@ -35,4 +37,8 @@ void gdb_send(struct gdb_conn *conn, const uint8_t *command, size_t size);
 
 uint8_t *gdb_recv(struct gdb_conn *conn, size_t *size);
 
+int gdb_wait(struct gdb_conn *conn, int timeout_ms);
+
+void gdb_interrupt(struct gdb_conn *conn);
+
 const char * gdb_start_noack(struct gdb_conn *conn);
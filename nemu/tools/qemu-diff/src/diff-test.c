@@ -2,12 +2,15 @@
 #include <sys/prctl.h>
 #include <signal.h>
 #include "isa.h"
+#include "../../../include/monitor/diff-hash.h"
 
 bool gdb_connect_qemu(void);
 bool gdb_memcpy_to_qemu(uint32_t, void *, int);
+bool gdb_memcpy_from_qemu(void *, uint32_t, int);
 bool gdb_getregs(union isa_gdb_regs *);
 bool gdb_setregs(union isa_gdb_regs *);
 bool gdb_si(void);
+bool gdb_run_to(uint32_t pc, uint64_t hits);
 void gdb_exit(void);
 
 void init_isa(void);
@@ -17,6 +20,16 @@ void difftest_memcpy_from_dut(paddr_t dest, void *src, size_t n) {
   assert(ok == 1);
 }
 
+uint64_t difftest_memhash(paddr_t addr, size_t n) {
+  uint8_t *buf = malloc(n);
+  assert(buf != NULL);
+  bool ok = gdb_memcpy_from_qemu(buf, addr, n);
+  assert(ok == 1);
+  uint64_t hash = diff_hash(buf, n);
+  free(buf);
+  return hash;
+}
+
 void difftest_getregs(void *r) {
   union isa_gdb_regs qemu_r;
   gdb_getregs(&qemu_r);
@@ -34,6 +47,17 @@ void difftest_exec(uint64_t n) {
   while (n --) gdb_si();
 }
 
+/* Execute `n' instructions, which end at the `hits'-th time `pc' is
+ * reached after the first one. This takes one GDB round trip per hit
+ * instead of one per instruction. */
+void difftest_exec_to(uint64_t n, uint32_t pc, uint64_t hits) {
+  if (n == 0) return;
+
+  // the first instruction may start at `pc' itself
+  gdb_si();
+  if (hits > 0 && !gdb_run_to(pc, hits)) difftest_exec(n - 1);
+}
+
 void difftest_init(void) {
   int ppid_before_fork = getpid();
   int pid = fork();
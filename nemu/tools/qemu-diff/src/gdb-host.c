@@ -2,38 +2,125 @@
 
 static struct gdb_conn *conn;
 
+// the largest packet the stub accepts, reported by qSupported
+static size_t packet_size = 1024;
+static bool binary_ok = true;
+static bool ack_mode = true;
+
+// X packets on the fly before their replies are read
+#define MAX_INFLIGHT 32
+
+static void gdb_query_supported(void) {
+  static const char cmd[] = "qSupported";
+  gdb_send(conn, (const uint8_t *)cmd, sizeof(cmd) - 1);
+
+  size_t size;
+  uint8_t *reply = gdb_recv(conn, &size);
+  char *p = strstr((const char *)reply, "PacketSize=");
+  if (p != NULL) {
+    size_t n = strtoul(p + strlen("PacketSize="), NULL, 16);
+    if (n > 64) packet_size = n;
+  }
+  free(reply);
+}
+
 bool gdb_connect_qemu(void) {
   // connect to gdbserver on localhost port 1234
   while ((conn = gdb_begin_inet("127.0.0.1", 1234)) == NULL) {
     usleep(1);
   }
 
+  gdb_query_supported();
+
+  // let memory accesses use physical addresses, as NEMU does
+  static const char phy[] = "Qqemu.PhyMemMode:1";
+  gdb_send(conn, (const uint8_t *)phy, sizeof(phy) - 1);
+  size_t size;
+  free(gdb_recv(conn, &size));
+
+  // without acks, a packet costs one write() and its reply one read()
+  ack_mode = (strcmp(gdb_start_noack(conn), "OK") != 0);
+
   return true;
 }
 
+static bool reply_ok(void) {
+  size_t size;
+  uint8_t *reply = gdb_recv(conn, &size);
+  bool ok = !strcmp((const char*)reply, "OK");
+  free(reply);
+  return ok;
+}
+
 static bool gdb_memcpy_to_qemu_small(uint32_t dest, void *src, int len) {
   char *buf = malloc(len * 2 + 128);
   assert(buf != NULL);
   int p = sprintf(buf, "M0x%x,%x:", dest, len);
   int i;
   for (i = 0; i < len; i ++) {
-    p += sprintf(buf + p, "%c%c", hex_encode(((uint8_t *)src)[i] >> 4), hex_encode(((uint8_t *)src)[i] & 0xf));
+    buf[p ++] = hex_encode(((uint8_t *)src)[i] >> 4);
+    buf[p ++] = hex_encode(((uint8_t *)src)[i] & 0xf);
   }
 
-  gdb_send(conn, (const uint8_t *)buf, strlen(buf));
+  gdb_send(conn, (const uint8_t *)buf, p);
   free(buf);
 
-  size_t size;
-  uint8_t *reply = gdb_recv(conn, &size);
-  bool ok = !strcmp((const char*)reply, "OK");
-  free(reply);
+  return reply_ok();
+}
 
-  return ok;
+/* Send one X packet with as much of `src' as fits, and return the number
+ * of bytes sent. The reply is not read. */
+static size_t gdb_send_binary(uint32_t dest, const void *src, size_t len, uint8_t *buf) {
+  int p = sprintf((char *)buf, "X%x,", dest);
+  size_t n = len;
+  // leave room for the length, which is written after encoding,
+  // and keep clear of the exact limit of the stub
+  size_t size = gdb_encode_binary(buf + p + 9, packet_size - 16 - p - 9, src, &n);
+  int q = sprintf((char *)buf + p, "%zx:", n);
+  memmove(buf + p + q, buf + p + 9, size);
+
+  gdb_send(conn, buf, p + q + size);
+  return n;
 }
 
 bool gdb_memcpy_to_qemu(uint32_t dest, void *src, int len) {
-  const int mtu = 1500;
   bool ok = true;
+  if (binary_ok) {
+    uint8_t *buf = malloc(packet_size);
+    assert(buf != NULL);
+
+    // find out whether X is supported with the first packet
+    size_t n = gdb_send_binary(dest, src, len, buf);
+    size_t size;
+    uint8_t *reply = gdb_recv(conn, &size);
+    binary_ok = (size != 0);
+    ok = !strcmp((const char*)reply, "OK");
+    free(reply);
+
+    if (binary_ok) {
+      dest += n; src += n; len -= n;
+
+      // keep several packets on the fly to hide the round trips
+      int inflight = 0;
+      while (len > 0) {
+        n = gdb_send_binary(dest, src, len, buf);
+        dest += n; src += n; len -= n;
+        if (++ inflight == MAX_INFLIGHT || ack_mode) {
+          ok &= reply_ok();
+          inflight --;
+        }
+      }
+      while (inflight -- > 0) {
+        ok &= reply_ok();
+      }
+      free(buf);
+      return ok;
+    }
+    free(buf);
+  }
+
+  const int mtu = (packet_size - 128) / 2;
+  ok = true;
   while (len > mtu) {
     ok &= gdb_memcpy_to_qemu_small(dest, src, mtu);
     dest += mtu;
@@ -44,21 +131,47 @@ bool gdb_memcpy_to_qemu(uint32_t dest, void *src, int len) {
   return ok;
 }
 
+bool gdb_memcpy_from_qemu(void *dest, uint32_t src, int len) {
+  const int mtu = (packet_size - 16) / 2;
+  uint8_t *p = dest;
+  while (len > 0) {
+    int n = (len < mtu ? len : mtu);
+    char buf[32];
+    int size = sprintf(buf, "m%x,%x", src, n);
+    gdb_send(conn, (const uint8_t *)buf, size);
+
+    size_t reply_size;
+    uint8_t *reply = gdb_recv(conn, &reply_size);
+    bool ok = (reply_size == n * 2);
+    int i;
+    for (i = 0; ok && i < n; i ++) {
+      uint16_t byte = gdb_decode_hex(reply[i * 2], reply[i * 2 + 1]);
+      ok = (byte != UINT16_MAX);
+      p[i] = byte;
+    }
+    free(reply);
+    if (!ok) return false;
+
+    p += n;
+    src += n;
+    len -= n;
+  }
+  return true;
+}
+
 bool gdb_getregs(union isa_gdb_regs *r) {
   gdb_send(conn, (const uint8_t *)"g", 1);
   size_t size;
   uint8_t *reply = gdb_recv(conn, &size);
 
-  int i;
-  uint8_t *p = reply;
-  uint8_t c;
-  for (i = 0; i < sizeof(union isa_gdb_regs) / sizeof(uint32_t); i ++) {
-    c = p[8];
-    p[8] = '\0';
-    r->array[i] = gdb_decode_hex_str(p);
-    p[8] = c;
-    p += 8;
+  // the registers are in target byte order, which is also ours
+  uint8_t *dst = (void *)r;
+  size_t i, n = size / 2;
+  if (n > sizeof(*r)) n = sizeof(*r);
+  for (i = 0; i < n; i ++) {
+    dst[i] = gdb_decode_hex(reply[i * 2], reply[i * 2 + 1]);
   }
+  memset(dst + n, 0, sizeof(*r) - n);
 
   free(reply);
 
@@ -75,26 +188,59 @@ bool gdb_setregs(union isa_gdb_regs *r) {
   int p = 1;
   int i;
   for (i = 0; i < len; i ++) {
-    p += sprintf(buf + p, "%c%c", hex_encode(((uint8_t *)src)[i] >> 4), hex_encode(((uint8_t *)src)[i] & 0xf));
+    buf[p ++] = hex_encode(((uint8_t *)src)[i] >> 4);
+    buf[p ++] = hex_encode(((uint8_t *)src)[i] & 0xf);
   }
 
-  gdb_send(conn, (const uint8_t *)buf, strlen(buf));
+  gdb_send(conn, (const uint8_t *)buf, p);
   free(buf);
 
+  return reply_ok();
+}
+
+bool gdb_si(void) {
+  char buf[] = "vCont;s:1";
+  gdb_send(conn, (const uint8_t *)buf, strlen(buf));
   size_t size;
   uint8_t *reply = gdb_recv(conn, &size);
-  bool ok = !strcmp((const char*)reply, "OK");
   free(reply);
-
-  return ok;
+  return true;
 }
 
-bool gdb_si(void) {
-  char buf[] = "vCont;s:1";
+static bool gdb_breakpoint(char type, uint32_t addr) {
+  char buf[32];
+  sprintf(buf, "%c0,%x,1", type, addr);
   gdb_send(conn, (const uint8_t *)buf, strlen(buf));
   size_t size;
   uint8_t *reply = gdb_recv(conn, &size);
+  bool ok = !strcmp((const char*)reply, "OK");
   free(reply);
+  return ok;
+}
+
+/* Continue until `pc' is reached `hits' times. Return false if QEMU
+ * does not take the breakpoint. */
+bool gdb_run_to(uint32_t pc, uint64_t hits) {
+  if (!gdb_breakpoint('Z', pc)) return false;
+
+  char buf[] = "vCont;c";
+  while (hits -- > 0) {
+    gdb_send(conn, (const uint8_t *)buf, strlen(buf));
+    bool stopped = gdb_wait(conn, 1000);
+    if (!stopped) {
+      // `pc' is not reached, and QEMU has run away from NEMU
+      gdb_interrupt(conn);
+    }
+    size_t size;
+    uint8_t *reply = gdb_recv(conn, &size);
+    free(reply);
+    if (!stopped) {
+      printf("QEMU does not reach pc = 0x%08x\n", pc);
+      break;
+    }
+  }
+
+  gdb_breakpoint('z', pc);
   return true;
 }
 
@@ -20,6 +20,7 @@
 #include "common.h"
 #include <ctype.h>
 #include <err.h>
+#include <errno.h>
 #include <stdbool.h>
 
 #include <arpa/inet.h>
@@ -29,13 +30,22 @@
 
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <poll.h>
 
+#define GDB_BUF_SIZE 65536
+
+/* The connection is a raw socket with our own buffers, so that a packet
+ * is sent with one write() and replies are read a buffer at a time. */
 struct gdb_conn {
-  FILE *in;
-  FILE *out;
+  int fd;
   bool ack;
-};
 
+  uint8_t in[GDB_BUF_SIZE];
+  size_t in_pos, in_len;
+
+  uint8_t *out;
+  size_t out_size;
+};
 
 static uint8_t
 hex_nibble(uint8_t hex) {
@@ -46,6 +56,28 @@ uint8_t hex_encode(uint8_t digit) {
   return digit > 9 ? 'a' + digit - 10 : '0' + digit;
 }
 
+/* Escape `*size' bytes of `src' as the binary data of an `X' packet into
+ * `dst', which holds at most `dst_size' bytes. Return the number of bytes
+ * written, and set `*size' to the number of bytes of `src' consumed. */
+size_t gdb_encode_binary(uint8_t *dst, size_t dst_size, const uint8_t *src, size_t *size) {
+  size_t i, p = 0;
+  for (i = 0; i < *size; i ++) {
+    uint8_t c = src[i];
+    if (c == '$' || c == '#' || c == '}' || c == '*') {
+      if (p + 2 > dst_size)
+        break;
+      dst[p++] = '}';
+      dst[p++] = c ^ 0x20;
+    } else {
+      if (p + 1 > dst_size)
+        break;
+      dst[p++] = c;
+    }
+  }
+  *size = i;
+  return p;
+}
+
 uint16_t gdb_decode_hex(uint8_t msb, uint8_t lsb) {
   if (!isxdigit(msb) || !isxdigit(lsb))
     return UINT16_MAX;
@@ -64,31 +96,52 @@ uint64_t gdb_decode_hex_str(uint8_t *bytes) {
 }
 
 
+static int conn_getc(struct gdb_conn *conn) {
+  if (conn->in_pos == conn->in_len) {
+    ssize_t n;
+    do {
+      n = read(conn->fd, conn->in, sizeof(conn->in));
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+      err(1, "recv");
+    if (n == 0)
+      return EOF;
+    conn->in_pos = 0;
+    conn->in_len = n;
+  }
+  return conn->in[conn->in_pos++];
+}
+
+// only valid right after conn_getc() returned a character
+static void conn_ungetc(struct gdb_conn *conn) {
+  conn->in_pos--;
+}
+
+static void conn_write(struct gdb_conn *conn, const uint8_t *buf, size_t size) {
+  while (size > 0) {
+    ssize_t n = write(conn->fd, buf, size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      err(1, "send");
+    }
+    if (n == 0)
+      errx(0, "send: Connection closed");
+    buf += n;
+    size -= n;
+  }
+}
+
 static struct gdb_conn* gdb_begin(int fd) {
-  struct gdb_conn *conn = calloc(1, sizeof(struct gdb_conn *));
+  struct gdb_conn *conn = calloc(1, sizeof(struct gdb_conn));
   if (conn == NULL)
     err(1, "calloc");
 
+  conn->fd = fd;
   conn->ack = true;
 
-  // duplicate the handle to separate read/write state
-  int fd2 = dup(fd);
-  if (fd2 < 0)
-    err(1, "dup");
-
-  // open a FILE* for reading
-  conn->in = fdopen(fd, "rb");
-  if (conn->in == NULL)
-    err(1, "fdopen");
-
-  // open a FILE* for writing
-  conn->out = fdopen(fd2, "wb");
-  if (conn->out == NULL)
-    err(1, "fdopen");
-
   // reset line state by acking any earlier input
-  fputc('+', conn->out);
-  fflush(conn->out);
+  conn_write(conn, (const uint8_t *)"+", 1);
 
   return conn;
 }
@@ -131,12 +184,20 @@ struct gdb_conn* gdb_begin_inet(const char *addr, uint16_t port) {
 
 
 void gdb_end(struct gdb_conn *conn) {
-  fclose(conn->in);
-  fclose(conn->out);
+  close(conn->fd);
+  free(conn->out);
   free(conn);
 }
 
-static void send_packet(FILE *out, const uint8_t *command, size_t size) {
+static void send_packet(struct gdb_conn *conn, const uint8_t *command, size_t size) {
+  // '$', the payload, '#' and two digits of checksum
+  if (conn->out_size < size + 4) {
+    conn->out_size = size + 4;
+    conn->out = realloc(conn->out, conn->out_size);
+    if (conn->out == NULL)
+      err(1, "realloc");
+  }
+
   // compute the checksum -- simple mod256 addition
   uint8_t sum = 0;
   size_t i;
@@ -147,31 +208,31 @@ static void send_packet(FILE *out, const uint8_t *command, size_t size) {
   // gdbserver.  e.g. giving "invalid hex digit" on an RLE'd address.
   // So just write raw here, and maybe let higher levels escape/RLE.
 
-  fputc('$', out); // packet start
-  fwrite(command, 1, size, out); // payload
-  fprintf(out, "#%02X", sum); // packet end, checksum
-  fflush(out);
+  uint8_t *p = conn->out;
+  *p++ = '$'; // packet start
+  memcpy(p, command, size); // payload
+  p += size;
+  *p++ = '#'; // packet end, checksum
+  *p++ = hex_encode(sum >> 4);
+  *p++ = hex_encode(sum & 0xf);
 
-  if (ferror(out))
-    err(1, "send");
-  else if (feof(out))
-    errx(0, "send: Connection closed");
+  conn_write(conn, conn->out, p - conn->out);
 }
 
 void gdb_send(struct gdb_conn *conn, const uint8_t *command, size_t size) {
   bool acked = false;
   do {
-    send_packet(conn->out, command, size);
+    send_packet(conn, command, size);
 
     if (!conn->ack)
       break;
 
     // look for '+' ACK or '-' NACK/resend
-    acked = fgetc(conn->in) == '+';
+    acked = conn_getc(conn) == '+';
   } while (!acked);
 }
 
-static uint8_t* recv_packet(FILE *in, size_t *ret_size, bool* ret_sum_ok) {
+static uint8_t* recv_packet(struct gdb_conn *conn, size_t *ret_size, bool* ret_sum_ok) {
   size_t i = 0;
   size_t size = 4096;
   uint8_t *reply = malloc(size);
@@ -183,9 +244,9 @@ static uint8_t* recv_packet(FILE *in, size_t *ret_size, bool* ret_sum_ok) {
   bool escape = false;
 
   // fast-forward to the first start of packet
-  while ((c = fgetc(in)) != EOF && c != '$');
+  while ((c = conn_getc(conn)) != EOF && c != '$');
 
-  while ((c = fgetc(in)) != EOF) {
+  while ((c = conn_getc(conn)) != EOF) {
     sum += c;
     switch (c) {
       case '$': // new packet?  start over...
@@ -197,8 +258,8 @@ static uint8_t* recv_packet(FILE *in, size_t *ret_size, bool* ret_sum_ok) {
       case '#': // end of packet
         sum -= c; // not part of the checksum
         {
-          uint8_t msb = fgetc(in);
-          uint8_t lsb = fgetc(in);
+          uint8_t msb = conn_getc(conn);
+          uint8_t lsb = conn_getc(conn);
           *ret_sum_ok = sum == gdb_decode_hex(msb, lsb);
         }
         *ret_size = i;
@@ -224,10 +285,11 @@ static uint8_t* recv_packet(FILE *in, size_t *ret_size, bool* ret_sum_ok) {
         // The count character can't be >126 or '$'/'#' packet markers.
 
         if (i > 0) { // need something to repeat!
-          int c2 = fgetc(in);
+          int c2 = conn_getc(conn);
           if (c2 < 29 || c2 > 126 || c2 == '$' || c2 == '#') {
             // invalid count character!
-            ungetc(c2, in);
+            if (c2 != EOF)
+              conn_ungetc(conn);
           } else {
             int count = c2 - 29;
 
@@ -266,31 +328,47 @@ static uint8_t* recv_packet(FILE *in, size_t *ret_size, bool* ret_sum_ok) {
     reply[i++] = c;
   }
 
-  if (ferror(in))
-    err(1, "recv");
-  else if (feof(in))
-    errx(0, "recv: Connection closed");
-  else
-    errx(1, "recv: Unknown connection error");
+  errx(0, "recv: Connection closed");
 }
 
 uint8_t* gdb_recv(struct gdb_conn *conn, size_t *size) {
   uint8_t *reply;
   bool acked = false;
   do {
-    reply = recv_packet(conn->in, size, &acked);
+    reply = recv_packet(conn, size, &acked);
 
     if (!conn->ack)
       break;
 
     // send +/- depending on checksum result, retry if needed
-    fputc(acked ? '+' : '-', conn->out);
-    fflush(conn->out);
+    conn_write(conn, (const uint8_t *)(acked ? "+" : "-"), 1);
   } while (!acked);
 
   return reply;
 }
 
+/* Wait at most `timeout_ms' milliseconds for a reply. Return 0 on a
+ * timeout. */
+int gdb_wait(struct gdb_conn *conn, int timeout_ms) {
+  // the reply may already be read into the buffer
+  if (conn->in_pos < conn->in_len)
+    return 1;
+
+  struct pollfd pfd = { .fd = conn->fd, .events = POLLIN };
+  int r;
+  do {
+    r = poll(&pfd, 1, timeout_ms);
+  } while (r < 0 && errno == EINTR);
+  if (r < 0)
+    err(1, "poll");
+  return r > 0;
+}
+
+/* Stop the target while it is running. It answers with a stop reply. */
+void gdb_interrupt(struct gdb_conn *conn) {
+  conn_write(conn, (const uint8_t *)"\x03", 1);
+}
+
 const char* gdb_start_noack(struct gdb_conn *conn) {
   static const char cmd[] = "QStartNoAckMode";
   gdb_send(conn, (const uint8_t *)cmd, sizeof(cmd) - 1);